@@ -1,19 +1,44 @@
 #include <MLX42/MLX42.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <fdf.h>
-#include <gnl/get_next_line.h>
 #include <libft/ftio/ftio.h>
 #include <libft/ftypes.h>
 #include <libft/libft.h>
+#include <lodepng/lodepng.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h> // rename
 #include <stdlib.h> //for free/malloc
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #define WIN_WIDTH 1280
 #define WIN_HEIGHT 1080
 #define DIST_SCALE 5 // px
 #define COLOR_SCALE 20
+#define POINT_RADIUS 2 // px
+#define TILE_SIZE 64     // px, side of a rasterizer tile
+#define MAX_WORKERS 64
+// maps with fewer vertices are rasterized serially, binning would not pay
+#define TILED_MIN_VERTICES 4096
+// vertices are indexed with u32, keep headroom for index + width
+#define MAX_MAP_CELLS (1u << 31)
+// text maps are parsed in parallel in chunks of at least this many bytes
+#define PARSE_CHUNK_MIN (1 << 20)
+// clears bigger than this use non-temporal stores, set to SIZE_MAX to disable
+#define CLEAR_STREAM_BYTES (16 << 20)
+// --frames is capped to this, every frame keeps its timing samples
+#define MAX_BENCH_FRAMES 100000
 
 #define RED 0xff0000ff
 #define BLUE 0x0000ffff
@@ -26,6 +51,14 @@ typedef struct vec2_s {
   i32 y;
 } vec2;
 
+// half-open pixel rectangle [x0, x1) x [y0, y1)
+typedef struct rect_s {
+  i32 x0;
+  i32 y0;
+  i32 x1;
+  i32 y1;
+} rect_t;
+
 typedef struct color_s {
   u8 r;
   u8 g;
@@ -33,12 +66,62 @@ typedef struct color_s {
   u8 a;
 } Color;
 
+typedef struct pyramid_s pyramid_t;
+
+// heights are one contiguous row-major grid: cell (x, y) is
+// heights[y * stride + x], with `len` rows of `width` cells each. colors is
+// laid out the same way, 0xRRGGBBAA or 0 for cells without a color, and is
+// NULL when no cell of the map has one. Maps loaded from a .fdfb file point
+// their planes straight into `mapping` instead of owning them
 typedef struct fdfmap_s {
-  i32 **buf;
+  i32 *heights;
+  u32 *colors;
   u32 len;
   u32 width;
+  u32 stride;
+  void *mapping;
+  size_t mapping_size;
+  // built once the map is fully loaded, NULL if its heights do not fit
+  pyramid_t *pyramid;
 } fdfmap_t;
 
+// lowest and highest height of a block of the map
+typedef struct minmax_s {
+  i16 min;
+  i16 max;
+} minmax_t;
+
+// min/max mipmap of the heights: level l, from 1 to `levels`, holds one
+// minmax_t per 2^l x 2^l block of the map, blocks on the right and bottom
+// borders being cut short. The last level is a single block. Only built for
+// maps whose heights fit in i16, it then costs a third of the map's heights
+struct pyramid_s {
+  u32 levels;
+  // level l is blocks[l - 1], rows of widths[l - 1] blocks
+  minmax_t *blocks[32];
+  u32 widths[32];
+  u32 lens[32];
+};
+
+void free_pyramid(pyramid_t *pyramid) {
+  if (!pyramid)
+    return;
+  for (u32 l = 0; l < pyramid->levels; ++l)
+    free(pyramid->blocks[l]);
+  free(pyramid);
+}
+
+minmax_t pyramid_block(const pyramid_t *pyramid, u32 level, u32 x, u32 y) {
+  return pyramid->blocks[level - 1][(size_t)y * pyramid->widths[level - 1] +
+                                    x];
+}
+
+// the height standing for a block: whichever extreme is the farthest from
+// 0, the highest one on ties
+i32 minmax_height(minmax_t block) {
+  return -(i32)block.min > block.max ? block.min : block.max;
+}
+
 u32 color_to_hex(Color *c) {
   u32 hex = 0x0;
   hex = (hex << 8) + c->r;
@@ -48,6 +131,10 @@ u32 color_to_hex(Color *c) {
   return hex;
 }
 
+Color hex_to_color(u32 hex) {
+  return (Color){hex >> 24, hex >> 16, hex >> 8, hex};
+}
+
 u32 ft_abs(i32 n) { return n < 0 ? -n : n; }
 
 u32 euclidian_dist_sq(vec2 *src, vec2 *dst) {
@@ -56,67 +143,176 @@ u32 euclidian_dist_sq(vec2 *src, vec2 *dst) {
   return ft_abs(dx * dx + dy * dy);
 }
 
-void draw_circle(mlx_image_t *img, vec2 *center_pos, u32 radius, Color *color) {
-  u32 c = color_to_hex(color);
-  for (u32 x = center_pos->x - radius; x < center_pos->x + radius; ++x) {
-    for (u32 y = center_pos->y - radius; y < center_pos->y + radius; ++y) {
-      vec2 p = {.x = x, .y = y};
-      if (euclidian_dist_sq(center_pos, &p) < radius * radius) {
-        mlx_put_pixel(img, x, y, c);
-      }
-    }
+// mlx stores each pixel as its R, G, B and A bytes in that order, so a
+// 0xRRGGBBAA color has to be byte swapped to be stored as one u32
+u32 pack_color(u32 color) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap32(color);
+#else
+  return color;
+#endif
+}
+
+u32 *pixel_at(mlx_image_t *img, i32 x, i32 y) {
+  return (u32 *)img->pixels + (size_t)y * img->width + x;
+}
+
+// fills pixels [x0, x1) of row y, clipped to `clip`
+void fill_span(mlx_image_t *img, i32 x0, i32 x1, i32 y, u32 packed,
+               rect_t *clip) {
+  if (y < clip->y0 || y >= clip->y1)
+    return;
+  if (x0 < clip->x0)
+    x0 = clip->x0;
+  if (x1 > clip->x1)
+    x1 = clip->x1;
+  u32 *p = pixel_at(img, x0, y);
+  for (i32 x = x0; x < x1; ++x)
+    *p++ = packed;
+}
+
+// fills pixels [y0, y1) of column x, clipped to `clip`
+void fill_vspan(mlx_image_t *img, i32 x, i32 y0, i32 y1, u32 packed,
+                rect_t *clip) {
+  if (x < clip->x0 || x >= clip->x1)
+    return;
+  if (y0 < clip->y0)
+    y0 = clip->y0;
+  if (y1 > clip->y1)
+    y1 = clip->y1;
+  u32 *p = pixel_at(img, x, y0);
+  for (i32 y = y0; y < y1; ++y, p += img->width)
+    *p = packed;
+}
+
+void draw_circle_clipped(mlx_image_t *img, vec2 *center_pos, u32 radius,
+                         Color *color, rect_t *clip) {
+  u32 packed = pack_color(color_to_hex(color));
+  i32 r = radius;
+  // one clipped span per row: every dx in [-r, r) with dx^2 + dy^2 < r^2
+  for (i32 dy = -r + 1; dy < r; ++dy) {
+    i32 half = 0;
+    while ((half + 1) * (half + 1) + dy * dy < r * r)
+      ++half;
+    i32 right = half < r - 1 ? half : r - 1;
+    fill_span(img, center_pos->x - half, center_pos->x + right + 1,
+              center_pos->y + dy, packed, clip);
   }
 }
 
 void draw_square(mlx_image_t *img, vec2 *center_pos, u32 radius, Color *color) {
   // io_printf("will draw at x:%d y:%d with a radius of %d\n", center_pos->x,
   //          center_pos->y, radius);
-  u32 c = color_to_hex(color);
-  for (u32 x = center_pos->x - radius; x < center_pos->x + radius; ++x) {
-    for (u32 y = center_pos->y - radius; y < center_pos->y + radius; ++y) {
-      mlx_put_pixel(img, x, y, c);
-    }
+  u32 packed = pack_color(color_to_hex(color));
+  rect_t all = {0, 0, img->width, img->height};
+  i32 r = radius;
+  for (i32 y = center_pos->y - r; y < center_pos->y + r; ++y)
+    fill_span(img, center_pos->x - r, center_pos->x + r, y, packed, &all);
+}
+
+// k range of a line's Bresenham steps whose major axis lies in [lo, hi)
+void clip_major(i32 from, i32 inc, i32 lo, i32 hi, i64 *kmin, i64 *kmax) {
+  i64 a = inc > 0 ? (i64)lo - from : (i64)from - (hi - 1);
+  i64 b = inc > 0 ? (i64)hi - 1 - from : (i64)from - lo;
+  *kmin = a > *kmin ? a : *kmin;
+  *kmax = b < *kmax ? b : *kmax;
+}
+
+// same on the minor axis, which at step k sits at floor(k * ad_m / ad_M)
+void clip_minor(i32 from, i32 inc, i32 lo, i32 hi, i64 ad_m, i64 ad_M,
+                i64 *kmin, i64 *kmax) {
+  i64 qa = inc > 0 ? (i64)lo - from : (i64)from - (hi - 1);
+  i64 qb = inc > 0 ? (i64)hi - 1 - from : (i64)from - lo;
+  if (qb < 0) {
+    *kmax = -1;
+    return;
+  }
+  if (qa > 0) {
+    i64 a = (qa * ad_M + ad_m - 1) / ad_m;
+    *kmin = a > *kmin ? a : *kmin;
   }
+  i64 b = ((qb + 1) * ad_M - 1) / ad_m;
+  *kmax = b < *kmax ? b : *kmax;
 }
 
-void draw_line(mlx_image_t *img, vec2 *src, vec2 *dst, u32 color) {
+// plots the line from src up to, but excluding, dst, restricted to `clip`.
+// The clip is a Liang-Barsky style parametric one done in integer Bresenham
+// steps: the first and last visible steps are solved for up front and the
+// error term is seeded for the first one, so exactly the pixels the
+// unclipped walk would have put inside `clip` are drawn, and off-screen
+// segments cost nothing
+void draw_line_clipped(mlx_image_t *img, vec2 *src, vec2 *dst, u32 color,
+                       rect_t *clip) {
   i32 dx = dst->x - src->x;
   i32 dy = dst->y - src->y;
+  // trivially outside: both ends past the same edge
+  if ((src->x < clip->x0 && dst->x < clip->x0) ||
+      (src->x >= clip->x1 && dst->x >= clip->x1) ||
+      (src->y < clip->y0 && dst->y < clip->y0) ||
+      (src->y >= clip->y1 && dst->y >= clip->y1))
+    return;
+  u32 packed = pack_color(color);
+
+  // axis aligned lines are plain spans
+  if (dy == 0) {
+    i32 x0 = dx > 0 ? src->x : dst->x + 1;
+    i32 x1 = dx > 0 ? dst->x : src->x + 1;
+    fill_span(img, x0, x1, src->y, packed, clip);
+    return;
+  }
+  if (dx == 0) {
+    i32 y0 = dy > 0 ? src->y : dst->y + 1;
+    i32 y1 = dy > 0 ? dst->y : src->y + 1;
+    fill_vspan(img, src->x, y0, y1, packed, clip);
+    return;
+  }
 
   i32 incX = dx < 0 ? -1 : 1;
   i32 incY = dy < 0 ? -1 : 1;
-  u32 e = 0;
-  vec2 cursor = {src->x, src->y};
-  // move by x
-  if (ft_abs(dx) >= ft_abs(dy)) {
-    for (; cursor.x != dst->x; cursor.x += incX) {
-      mlx_put_pixel(img, cursor.x, cursor.y, color);
-      e += ft_abs(dy);
-      if (e >= ft_abs(dx)) {
-        e -= ft_abs(dx);
-        cursor.y += incY;
-      }
-    }
+  bool by_x = ft_abs(dx) >= ft_abs(dy);
+  i64 ad_M = by_x ? ft_abs(dx) : ft_abs(dy);
+  i64 ad_m = by_x ? ft_abs(dy) : ft_abs(dx);
+  i64 kmin = 0;
+  i64 kmax = ad_M - 1;
+  if (by_x) {
+    clip_major(src->x, incX, clip->x0, clip->x1, &kmin, &kmax);
+    clip_minor(src->y, incY, clip->y0, clip->y1, ad_m, ad_M, &kmin, &kmax);
+  } else {
+    clip_major(src->y, incY, clip->y0, clip->y1, &kmin, &kmax);
+    clip_minor(src->x, incX, clip->x0, clip->x1, ad_m, ad_M, &kmin, &kmax);
   }
-  // move by y
-  else {
-    for (; cursor.y != dst->y; cursor.y += incY) {
-      mlx_put_pixel(img, cursor.x, cursor.y, color);
-      e += ft_abs(dx);
-      if (e >= ft_abs(dy)) {
-        e -= ft_abs(dy);
-        cursor.x += incX;
-      }
+  if (kmin > kmax)
+    return;
+
+  i64 q = kmin * ad_m / ad_M;
+  u32 e = kmin * ad_m - q * ad_M;
+  i32 w = img->width;
+  i32 stepM = by_x ? incX : incY * w;
+  i32 stepm = by_x ? incY * w : incX;
+  vec2 start = {src->x + (by_x ? kmin : q) * incX,
+                src->y + (by_x ? q : kmin) * incY};
+  u32 *p = pixel_at(img, start.x, start.y);
+  for (i64 k = kmin; k <= kmax; ++k, p += stepM) {
+    *p = packed;
+    e += ad_m;
+    if (e >= ad_M) {
+      e -= ad_M;
+      p += stepm;
     }
   }
 }
 
-void free_buf(i32 **buf, u32 len) {
-  for (u32 j = 0; j < len; ++j) {
-    if (buf[j])
-      free(buf[j]);
+void free_fdf(fdfmap_t *fdf) {
+  if (!fdf)
+    return;
+  if (fdf->mapping) {
+    munmap(fdf->mapping, fdf->mapping_size);
+  } else {
+    free(fdf->heights);
+    free(fdf->colors);
   }
-  free(buf);
+  free_pyramid(fdf->pyramid);
+  free(fdf);
 }
 
 vec2 rotate_line(vec2 *src, vec2 *dst, double angle) {
@@ -131,340 +327,3193 @@ vec2 rotate_line(vec2 *src, vec2 *dst, double angle) {
   return q;
 }
 
-void clear_image(mlx_image_t *img, u32 color) {
-  for (u32 i = 0; i < img->width; ++i) {
-    for (u32 j = 0; j < img->height; ++j) {
-      mlx_put_pixel(img, i, j, color);
-    }
+// fills n pixels with one packed color using aligned vector stores, that
+// bypass the cache when `stream` is set
+void fill_pixels(u32 *p, size_t n, u32 packed, bool stream) {
+#if defined(__AVX2__)
+  const size_t lanes = 8;
+  while (n && ((uintptr_t)p & 31)) {
+    *p++ = packed;
+    --n;
+  }
+  __m256i v = _mm256_set1_epi32(packed);
+  __m256i *q = (__m256i *)p;
+  size_t blocks = n / lanes;
+  if (stream) {
+    for (size_t i = 0; i < blocks; ++i)
+      _mm256_stream_si256(q + i, v);
+    _mm_sfence();
+  } else {
+    for (size_t i = 0; i < blocks; ++i)
+      _mm256_store_si256(q + i, v);
+  }
+  p += blocks * lanes;
+  n -= blocks * lanes;
+#elif defined(__SSE2__)
+  const size_t lanes = 4;
+  while (n && ((uintptr_t)p & 15)) {
+    *p++ = packed;
+    --n;
+  }
+  __m128i v = _mm_set1_epi32(packed);
+  __m128i *q = (__m128i *)p;
+  size_t blocks = n / lanes;
+  if (stream) {
+    for (size_t i = 0; i < blocks; ++i)
+      _mm_stream_si128(q + i, v);
+    _mm_sfence();
+  } else {
+    for (size_t i = 0; i < blocks; ++i)
+      _mm_store_si128(q + i, v);
   }
+  p += blocks * lanes;
+  n -= blocks * lanes;
+#else
+  (void)stream;
+#endif
+  while (n--)
+    *p++ = packed;
 }
 
-u32 buf_len(i32 **buf) {
-  u32 k = 0;
-  while (buf[k])
-    ++k;
-  return k;
+// clears `rect` (clipped to the image) row by row, rows spanning the whole
+// width are contiguous so they are filled as a single run
+void clear_rect(mlx_image_t *img, rect_t *rect, u32 color) {
+  u32 packed = pack_color(color);
+  i32 x0 = rect->x0 < 0 ? 0 : rect->x0;
+  i32 y0 = rect->y0 < 0 ? 0 : rect->y0;
+  i32 x1 = rect->x1 > (i32)img->width ? (i32)img->width : rect->x1;
+  i32 y1 = rect->y1 > (i32)img->height ? (i32)img->height : rect->y1;
+  if (x0 >= x1 || y0 >= y1)
+    return;
+  size_t row = x1 - x0;
+  size_t rows = y1 - y0;
+  bool stream = row * rows * sizeof(u32) >= CLEAR_STREAM_BYTES;
+  if (row == img->width) {
+    fill_pixels(pixel_at(img, 0, y0), row * rows, packed, stream);
+    return;
+  }
+  for (i32 y = y0; y < y1; ++y)
+    fill_pixels(pixel_at(img, x0, y), row, packed, stream);
 }
 
-fdfmap_t *load_fdf(int fd, char *fdf_path) {
-  i32 **buf = malloc(sizeof(i32 *) * 4096);
-  if (!buf) {
-    io_printf("error: could not malloc for buf of fdf\n");
+// fixed set of worker threads running indexed tasks: pool_run hands out
+// task indices [0, tasks) through an atomic counter to the workers and the
+// calling thread alike, and returns once all of them are done
+typedef void (*task_fn)(void *ctx, u32 task);
+
+typedef struct pool_s {
+  pthread_t threads[MAX_WORKERS];
+  u32 count;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  task_fn fn;
+  void *ctx;
+  u32 tasks;
+  atomic_uint next;
+  u32 busy;
+  u64 generation;
+  bool stop;
+} pool_t;
+
+void pool_drain(pool_t *pool) {
+  for (u32 t; (t = atomic_fetch_add(&pool->next, 1)) < pool->tasks;)
+    pool->fn(pool->ctx, t);
+}
+
+void *pool_worker(void *param) {
+  pool_t *pool = param;
+  u64 seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stop && pool->generation == seen)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->stop)
+      break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    pool_drain(pool);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy == 0)
+      pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+void free_pool(pool_t *pool) {
+  if (!pool)
+    return;
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (u32 i = 0; i < pool->count; ++i)
+    pthread_join(pool->threads[i], NULL);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->done);
+  free(pool);
+}
+
+// `threads` threads in total counting the caller, 0 for one per online core.
+// NULL when that is a single thread, callers then simply run serially
+pool_t *new_pool(u32 threads) {
+  long cores = threads ? threads : sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores <= 1)
     return NULL;
+  pool_t *pool = calloc(1, sizeof(pool_t));
+  if (!pool)
+    return NULL;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  u32 wanted = cores - 1 < MAX_WORKERS ? cores - 1 : MAX_WORKERS;
+  for (; pool->count < wanted; ++pool->count) {
+    if (pthread_create(&pool->threads[pool->count], NULL, pool_worker, pool))
+      break;
   }
-  char *line = get_next_line(fd);
-  if (!line) {
-    io_printf("error: initial line was NULL from gnl\n");
+  if (!pool->count) {
+    free_pool(pool);
     return NULL;
   }
+  return pool;
+}
 
-  u32 i = 0;
-  u32 word_count;
-  io_printf("loading fdf from `%s` into memory...", fdf_path);
-  while (line) {
+// number of threads taking part in pool_run, the caller included
+u32 pool_threads(pool_t *pool) { return pool ? pool->count + 1 : 1; }
+
+void pool_run(pool_t *pool, task_fn fn, void *ctx, u32 tasks) {
+  if (!pool) {
+    for (u32 t = 0; t < tasks; ++t)
+      fn(ctx, t);
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->ctx = ctx;
+  pool->tasks = tasks;
+  atomic_store(&pool->next, 0);
+  pool->busy = pool->count;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  pool_drain(pool);
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
 
-    word_count = 0;
-    char **split = ft_split(line, ' ');
-    while (split[word_count])
-      ++word_count;
+// the pyramid is built in strips of 2^PYRAMID_STRIP_LEVELS map rows, each
+// strip holding whole blocks of the levels up to PYRAMID_STRIP_LEVELS, so
+// strips are reduced in parallel without depending on each other. The few
+// levels above are reduced serially afterwards
+#define PYRAMID_STRIP_LEVELS 6
+
+typedef struct pyramid_build_s {
+  fdfmap_t *fdf;
+  pyramid_t *pyramid;
+  // set by strips holding heights out of the i16 range
+  atomic_bool overflow;
+} pyramid_build_t;
 
-    buf[i] = malloc(sizeof(i32) * (word_count) + 1);
-    for (u32 j = 0; j < word_count; ++j) {
-      buf[i][j] = ft_atoi(split[j]);
-      free(split[j]);
+// reduces rows [y0, y1) of level l from level l - 1
+void pyramid_level_rows(pyramid_t *pyramid, u32 l, u32 y0, u32 y1) {
+  const minmax_t *below = pyramid->blocks[l - 2];
+  u32 below_width = pyramid->widths[l - 2];
+  u32 below_len = pyramid->lens[l - 2];
+  minmax_t *blocks = pyramid->blocks[l - 1];
+  u32 width = pyramid->widths[l - 1];
+  for (u32 y = y0; y < y1; ++y) {
+    for (u32 x = 0; x < width; ++x) {
+      minmax_t m = below[(size_t)2 * y * below_width + 2 * x];
+      for (u32 k = 1; k < 4; ++k) {
+        u32 bx = 2 * x + (k & 1);
+        u32 by = 2 * y + (k >> 1);
+        if (bx >= below_width || by >= below_len)
+          continue;
+        minmax_t b = below[(size_t)by * below_width + bx];
+        m.min = b.min < m.min ? b.min : m.min;
+        m.max = b.max > m.max ? b.max : m.max;
+      }
+      blocks[(size_t)y * width + x] = m;
     }
-    buf[i][word_count] = INT_MAX;
-    free(split);
-    free(line);
+  }
+}
 
-    line = get_next_line(fd);
-    ++i;
+void pyramid_strip_task(void *ctx, u32 s) {
+  pyramid_build_t *build = ctx;
+  fdfmap_t *fdf = build->fdf;
+  pyramid_t *pyramid = build->pyramid;
+  u32 y0 = s << PYRAMID_STRIP_LEVELS;
+  u32 y1 = y0 + (1u << PYRAMID_STRIP_LEVELS) < fdf->len
+               ? y0 + (1u << PYRAMID_STRIP_LEVELS)
+               : fdf->len;
+  // level 1 straight from the heights, checking they fit
+  minmax_t *blocks = pyramid->blocks[0];
+  u32 width = pyramid->widths[0];
+  for (u32 y = y0 / 2; y < (y1 + 1) / 2; ++y) {
+    for (u32 x = 0; x < width; ++x) {
+      i32 min = INT_MAX;
+      i32 max = INT_MIN;
+      for (u32 by = 2 * y; by < 2 * y + 2 && by < fdf->len; ++by) {
+        const i32 *row = fdf->heights + (size_t)by * fdf->stride;
+        for (u32 bx = 2 * x; bx < 2 * x + 2 && bx < fdf->width; ++bx) {
+          min = row[bx] < min ? row[bx] : min;
+          max = row[bx] > max ? row[bx] : max;
+        }
+      }
+      if (min < INT16_MIN || max > INT16_MAX) {
+        atomic_store(&build->overflow, true);
+        return;
+      }
+      blocks[(size_t)y * width + x] = (minmax_t){min, max};
+    }
   }
-  fdfmap_t *fdf = malloc(sizeof(fdfmap_t));
-  fdf->buf = buf;
-  fdf->len = buf_len(fdf->buf);
-  fdf->width = word_count - 1;
+  for (u32 l = 2; l <= pyramid->levels && l <= PYRAMID_STRIP_LEVELS; ++l)
+    pyramid_level_rows(pyramid, l, y0 >> l, (y1 + (1u << l) - 1) >> l);
+}
 
-  io_printf("success\n");
-  return fdf;
+// builds the pyramid of a fully loaded map on up to `threads` threads, 0
+// meaning one per core. NULL if the heights do not fit in i16
+pyramid_t *new_pyramid(fdfmap_t *fdf, u32 threads) {
+  pyramid_t *pyramid = calloc(1, sizeof(pyramid_t));
+  if (!pyramid)
+    return NULL;
+  u32 width = fdf->width;
+  u32 len = fdf->len;
+  while (width > 1 || len > 1) {
+    width = (width + 1) / 2;
+    len = (len + 1) / 2;
+    u32 l = pyramid->levels;
+    pyramid->widths[l] = width;
+    pyramid->lens[l] = len;
+    pyramid->blocks[l] = malloc(sizeof(minmax_t) * width * len);
+    ++pyramid->levels;
+    if (!pyramid->blocks[l]) {
+      free_pyramid(pyramid);
+      return NULL;
+    }
+  }
+  if (!pyramid->levels) {
+    free(pyramid);
+    return NULL;
+  }
+  pyramid_build_t build = {.fdf = fdf, .pyramid = pyramid};
+  u32 strips = (fdf->len + (1u << PYRAMID_STRIP_LEVELS) - 1) >>
+               PYRAMID_STRIP_LEVELS;
+  pool_t *pool = strips > 1 ? new_pool(threads) : NULL;
+  pool_run(pool, pyramid_strip_task, &build, strips);
+  free_pool(pool);
+  if (atomic_load(&build.overflow)) {
+    free_pyramid(pyramid);
+    return NULL;
+  }
+  for (u32 l = PYRAMID_STRIP_LEVELS + 1; l <= pyramid->levels; ++l)
+    pyramid_level_rows(pyramid, l, 0, pyramid->lens[l - 1]);
+  return pyramid;
 }
 
-u8 normalize_hex(u32 hex) {
-  if (hex > 0xff) {
-    return 0xff;
+// value + 1 of every hex digit, 0 for any other byte
+const u8 hex_digits[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,  ['5'] = 6,
+    ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10, ['a'] = 11, ['b'] = 12,
+    ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16, ['A'] = 11, ['B'] = 12,
+    ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16};
+
+// parses one height token (`[-+]digits[,0xRRGGBB]`) at *cursor, like ft_atoi
+// but straight from the mapped bytes, and moves *cursor past the whole token.
+// *color gets the token's color as 0xRRGGBBAA, or 0 if it has none
+i32 parse_height(const char **cursor, const char *end, u32 *color) {
+  const char *p = *cursor;
+  bool negative = false;
+  // unsigned, so that out of range heights wrap instead of overflowing
+  u32 n = 0;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
   }
-  return hex;
+  while (p < end && *p >= '0' && *p <= '9')
+    n = n * 10 + (*p++ - '0');
+  *color = 0;
+  if (end - p > 3 && p[0] == ',' && p[1] == '0' && (p[2] | 0x20) == 'x') {
+    u32 rgb = 0;
+    u8 digit;
+    p += 3;
+    const char *hex = p;
+    while (p < end && (digit = hex_digits[(u8)*p])) {
+      rgb = rgb << 4 | (digit - 1);
+      ++p;
+    }
+    // a bare `0x` is no color, as it is at the end of the file
+    if (p != hex)
+      *color = rgb << 8 | 0xff;
+  }
+  // skip whatever suffix ft_atoi would have ignored
+  while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+    ++p;
+  *cursor = p;
+  return (i32)(negative ? 0u - n : n);
 }
 
-void draw_buf(mlx_image_t *img, fdfmap_t *fdf, u32 offset) {
+#if defined(__SSE2__)
+// classes of the 64 bytes at a block, one bit per byte
+typedef struct block_s {
+  u64 blank;
+  u64 newline;
+  u64 digit;
+  u64 hex;
+  u64 comma;
+  u64 sign;
+} block_t;
 
-  vec2 start = {(WIN_WIDTH - (fdf->width * offset)) / 2,
-                (WIN_HEIGHT - (fdf->len * offset)) / 2};
+#if defined(__AVX2__)
+#define BLOCK_LANES 32
+typedef __m256i lanes_t;
+#define lanes_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define lanes_set1 _mm256_set1_epi8
+#define lanes_eq _mm256_cmpeq_epi8
+#define lanes_or _mm256_or_si256
+#define lanes_sub _mm256_sub_epi8
+#define lanes_min _mm256_min_epu8
+#define lanes_mask(v) (u64)(u32) _mm256_movemask_epi8(v)
+#else
+#define BLOCK_LANES 16
+typedef __m128i lanes_t;
+#define lanes_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define lanes_set1 _mm_set1_epi8
+#define lanes_eq _mm_cmpeq_epi8
+#define lanes_or _mm_or_si128
+#define lanes_sub _mm_sub_epi8
+#define lanes_min _mm_min_epu8
+#define lanes_mask(v) (u64)(u16) _mm_movemask_epi8(v)
+#endif
 
-  if (start.x < 0 || start.x > WIN_WIDTH) {
-    start.x = 0;
-    offset = 2;
-  }
-  if (start.y < 0 || start.y > WIN_HEIGHT) {
-    start.y = 0;
-    offset = 2;
+void classify_block(const char *p, block_t *block) {
+  *block = (block_t){0};
+  for (u32 k = 0; k < 64; k += BLOCK_LANES) {
+    lanes_t c = lanes_load(p + k);
+    lanes_t blank = lanes_or(lanes_or(lanes_eq(c, lanes_set1(' ')),
+                                      lanes_eq(c, lanes_set1('\t'))),
+                             lanes_eq(c, lanes_set1('\r')));
+    // unsigned c - '0' <= 9, and (c | 0x20) - 'a' <= 5 for hex letters
+    lanes_t d = lanes_sub(c, lanes_set1('0'));
+    lanes_t digit = lanes_eq(lanes_min(d, lanes_set1(9)), d);
+    lanes_t l = lanes_sub(lanes_or(c, lanes_set1(0x20)), lanes_set1('a'));
+    lanes_t letter = lanes_eq(lanes_min(l, lanes_set1(5)), l);
+    block->blank |= lanes_mask(blank) << k;
+    block->newline |= lanes_mask(lanes_eq(c, lanes_set1('\n'))) << k;
+    block->digit |= lanes_mask(digit) << k;
+    block->hex |= lanes_mask(lanes_or(digit, letter)) << k;
+    block->comma |= lanes_mask(lanes_eq(c, lanes_set1(','))) << k;
+    block->sign |= lanes_mask(lanes_or(lanes_eq(c, lanes_set1('-')),
+                                       lanes_eq(c, lanes_set1('+'))))
+                   << k;
   }
+}
+#endif
 
-  io_printf("start(%d, %d)\n", start.x, start.y);
+// shape of a map as found by measure_rows
+typedef struct {
+  u32 len;
+  u32 min_width;
+  u32 max_width;
+  // whether any token carries a `,0x..` color
+  bool colored;
+} shape_t;
 
-  for (u32 i = 0; i < fdf->len; ++i) {
-    u32 j = 0;
-    while (fdf->buf[i][j] != INT_MAX) {
-      vec2 pos = {start.x + j * offset, start.y + i * offset};
-      if (pos.x < 0 || pos.x >= (i32)WIN_WIDTH || pos.y < 0 ||
-          pos.y >= (i32)WIN_HEIGHT) {
-        ++j;
-        continue;
-      }
+// counts a finished line of `count` tokens into `shape`
+bool add_line(shape_t *shape, u32 count) {
+  if (!count)
+    return true;
+  if (shape->len == UINT32_MAX)
+    return false;
+  ++shape->len;
+  if (count < shape->min_width)
+    shape->min_width = count;
+  if (count > shape->max_width)
+    shape->max_width = count;
+  return true;
+}
 
-      Color c = {normalize_hex(0x66 + fdf->buf[i][j] * COLOR_SCALE),
-                 normalize_hex(0x88 + fdf->buf[i][j] * COLOR_SCALE),
-                 normalize_hex(0x33 + fdf->buf[i][j] * COLOR_SCALE), 0xff};
+// single pass over the mapping counting the non-empty lines and the
+// narrowest and widest of them, tokens being runs of non-blank bytes.
+// Whole 64 byte blocks count token starts straight from their bit masks
+bool measure_rows(const char *p, const char *end, shape_t *shape) {
+  *shape = (shape_t){0, UINT32_MAX, 0, false};
+  u32 count = 0;
+  bool in_token = false;
+#if defined(__SSE2__)
+  u64 carry = 0;
+  for (; end - p >= 64; p += 64) {
+    block_t block;
+    classify_block(p, &block);
+    u64 token = ~(block.blank | block.newline);
+    u64 starts = token & ~(token << 1 | carry);
+    carry = token >> 63;
+    shape->colored |= block.comma != 0;
+    for (u64 nl = block.newline; nl; nl &= nl - 1) {
+      u64 before = (nl & -nl) - 1;
+      count += __builtin_popcountll(starts & before);
+      starts &= ~before;
+      if (!add_line(shape, count))
+        return false;
+      count = 0;
+    }
+    count += __builtin_popcountll(starts);
+  }
+  in_token = carry;
+#endif
+  for (; p < end; ++p) {
+    if (*p == '\n') {
+      if (!add_line(shape, count))
+        return false;
+      count = 0;
+      in_token = false;
+    } else if (*p == ' ' || *p == '\t' || *p == '\r') {
+      in_token = false;
+    } else {
+      count += !in_token;
+      in_token = true;
+      shape->colored |= *p == ',';
+    }
+  }
+  return add_line(shape, count);
+}
 
-      // io_printf("Color: (%x, %x, %x, %x)\n", c.r, c.g, c.b, c.a);
-      draw_square(img, &pos, offset / 1.8, &c);
-      ++j;
-    }
-  }
-}
-
-typedef struct iso_point_s {
-  vec2 *pos;
-  vec2 *east_conn;
-  vec2 *south_conn;
-} iso_point_t;
-
-// iso_point_t rec_iso_point_neighbors_of(vec2 *pos, fdfmap_t *fdf) {
-
-// stop condition -> found bottom_right corner has no south AND no east
-//  if (pos->x + 1 >= fdf->width && pos->y + 1 >= fdf->len) {
-//    return (iso_point_t){pos, NULL, NULL};
-//  }
-
-// right border, no east, but south
-// if (pos->x + 1 >= fdf->width && !(pos->y + 1 >= fdf->len)) {
-//  vec2 tmp = {pos->x, pos->y + 1};
-// iso_point_t south = rec_iso_point_neighbors_of(&tmp, fdf);
-// return (iso_point_t){pos, NULL, south.pos};
-// }
-// bottom border, no south but east
-// else if (pos->y >= fdf->len) {
-// vec2 tmp = {pos->x + 1, pos->y};
-//  iso_point_t east = rec_iso_point_neighbors_of(&tmp, fdf);
-//  return (iso_point_t){pos, east.pos, NULL};
-// }
-// has both east and south
-// else {
-// vec2 tmp_east = {pos->x + 1, pos->y};
-// vec2 tmp_south = {pos->x, pos->y + 1};
-// iso_point_t east = rec_iso_point_neighbors_of(&tmp_east, fdf);
-// iso_point_t south = rec_iso_point_neighbors_of(&tmp_south, fdf);
-// return (iso_point_t){pos, east.pos, south.pos};
-//}
-//}
-
-void clean_iso_points(iso_point_t *buf, u32 cursor) {
-  for (u32 i = 0; i < cursor; ++i) {
-    free(buf[i].pos);
-    free(buf[i].east_conn);
-    free(buf[i].south_conn);
+// where parse_rows is in the grid: the next cell to fill, in the row
+// starting at `row`
+typedef struct rows_s {
+  i32 *height;
+  u32 *color;
+  i32 *row;
+  u32 width;
+} rows_t;
+
+void push_height(rows_t *rows, i32 height, u32 color) {
+  *rows->height++ = height;
+  if (rows->color)
+    *rows->color++ = color;
+}
+
+// short rows are padded with zero heights and no color
+void end_row(rows_t *rows) {
+  u32 word = rows->height - rows->row;
+  if (!word)
+    return;
+  u32 missing = rows->width - word;
+  memset(rows->height, 0, sizeof(i32) * missing);
+  rows->height += missing;
+  if (rows->color) {
+    memset(rows->color, 0, sizeof(u32) * missing);
+    rows->color += missing;
   }
-  free(buf);
+  rows->row = rows->height;
 }
 
-// get all isometrics positions for all points of ftmap_t
-iso_point_t *iso_points(fdfmap_t *fdf, u32 offset_x, u32 offset_y, vec2 *origin,
-                        i32 height_scale) {
+#if defined(__SSE2__)
+// value of the n (1 to 8) decimal digits at p, 8 bytes being readable
+u32 swar_decimal(const char *p, u32 n) {
+  u64 v;
+  memcpy(&v, p, 8);
+  // the first digit lands in the lowest byte, shift the extra bytes out
+  v <<= 8 * (8 - n);
+  v = (v & 0x0f0f0f0f0f0f0f0full) * 2561 >> 8;
+  v = (v & 0x00ff00ff00ff00ffull) * 6553601 >> 16;
+  return (v & 0x0000ffff0000ffffull) * 42949672960001ull >> 32;
+}
 
-  iso_point_t *points = malloc(sizeof(iso_point_t) * (fdf->len * fdf->width));
-  if (!points)
-    return NULL;
-  u32 points_cursor = 0;
-  for (u32 y = 0; y < fdf->len; ++y) {
-    for (u32 x = 0; x < fdf->width; ++x) {
+// value of the n (1 to 8) hex digits at p, 8 bytes being readable
+u32 swar_hex(const char *p, u32 n) {
+  u64 v;
+  memcpy(&v, p, 8);
+  // letters have bit 6 set and are 9 below their value once masked
+  v = (v & 0x0f0f0f0f0f0f0f0full) + ((v & 0x4040404040404040ull) >> 6) * 9;
+  v = __builtin_bswap64(v) >> 8 * (8 - n);
+  v = (v | v >> 4) & 0x00ff00ff00ff00ffull;
+  v = (v | v >> 8) & 0x0000ffff0000ffffull;
+  return v | v >> 16;
+}
 
-      vec2 *pos = malloc(sizeof(vec2));
-      if (!pos) {
-        clean_iso_points(points, points_cursor);
-        return NULL;
-      }
-      pos->x = (x - y) * offset_x + origin->x;
-      pos->y = (x + y) * offset_y - fdf->buf[y][x] * height_scale + origin->y;
-
-      vec2 *east_conn;
-      if (x + 1 >= fdf->width) {
-        east_conn = NULL;
-      } else {
-        east_conn = malloc(sizeof(vec2));
-        if (!east_conn) {
-          clean_iso_points(points, points_cursor);
-          return NULL;
-        }
-        east_conn->x = ((x + 1) - y) * offset_x + origin->x;
-        east_conn->y = ((x + 1) + y) * offset_y -
-                       fdf->buf[y][x + 1] * height_scale + origin->y;
-      }
+// whether every token of the block starting at a bit of `starts` is a
+// plain `[-+]digits` one with at most 8 digits
+bool clean_block(block_t *block, u64 starts) {
+  u64 digit = block->digit;
+  u64 other = ~(digit | block->blank | block->newline | block->sign);
+  // bits starting a run of 9 digits
+  u64 runs = digit & digit >> 1;
+  runs &= runs >> 2;
+  runs &= runs >> 4;
+  runs &= digit >> 8;
+  return !other && !runs && !(block->sign & ~starts) &&
+         !(block->sign & ~(digit >> 1));
+}
+
+// the token at bit `pos` of the block at `p`, any token and color syntax
+void parse_token(const char *p, const char *end, block_t *block, u64 sep,
+                 u32 pos, rows_t *rows) {
+  const char *t = p + pos;
+  u32 len = __builtin_ctzll(sep >> pos);
+  u32 sign = (t[0] == '-') | (t[0] == '+');
+  u32 digits = __builtin_ctzll(~(block->digit >> (pos + sign)));
+  u32 color = 0;
+  bool plain = digits <= 8 && sign + digits == len;
+  if (!plain && digits <= 8 && sign + digits + 3 < len &&
+      len - sign - digits - 3 <= 8) {
+    const char *c = t + sign + digits;
+    u32 hex = len - sign - digits - 3;
+    u64 hex_mask = ((1ull << hex) - 1) << (pos + sign + digits + 3);
+    if (c[0] == ',' && c[1] == '0' && (c[2] | 0x20) == 'x' &&
+        (block->hex & hex_mask) == hex_mask) {
+      color = swar_hex(c + 3, hex) << 8 | 0xff;
+      plain = true;
+    }
+  }
+  if (!plain) {
+    i32 height = parse_height(&t, end, &color);
+    push_height(rows, height, color);
+    return;
+  }
+  i32 height = digits ? swar_decimal(t + sign, digits) : 0;
+  push_height(rows, t[0] == '-' ? -height : height, color);
+}
 
-      vec2 *south_conn;
-      if (y + 1 >= fdf->len) {
-        south_conn = NULL;
-      } else {
-        south_conn = malloc(sizeof(vec2));
-        if (!south_conn) {
-          clean_iso_points(points, points_cursor);
-          return NULL;
+// parses 64 byte blocks while at least 72 bytes are left, so every load
+// stays inside the mapping. Tokens are found from the block's bit masks,
+// and the plain `[-+]digits[,0xhex]` ones converted without looking at
+// their bytes one by one, the others going through parse_height. Blocks
+// made of plain uncolored tokens only skip the per token checks. Returns
+// where it stopped, never in the middle of a token
+const char *parse_blocks(const char *p, const char *end, rows_t *state) {
+  // a local copy the compiler can keep in registers
+  rows_t local = *state;
+  rows_t *rows = &local;
+  while (end - p >= 72) {
+    block_t block;
+    classify_block(p, &block);
+    u64 sep = block.blank | block.newline;
+    if (!sep) {
+      // a single token longer than a block
+      u32 color;
+      i32 height = parse_height(&p, end, &color);
+      push_height(rows, height, color);
+      continue;
+    }
+    // a token running past the last separator is left to the next block,
+    // which starts right on it
+    u32 last = 63 - __builtin_clzll(sep);
+    u64 complete = (2ull << last) - 1;
+    u64 token = ~sep;
+    u64 starts = token & ~(token << 1) & complete;
+    if (clean_block(&block, starts)) {
+      u64 newlines = block.newline;
+      for (;;) {
+        u64 row = newlines ? (newlines & -newlines) - 1 : complete;
+        for (u64 run = starts & row; run; run &= run - 1) {
+          u32 pos = __builtin_ctzll(run);
+          const char *t = p + pos;
+          u32 sign = block.sign >> pos & 1;
+          u32 digits = __builtin_ctzll(~(block.digit >> (pos + sign)));
+          i32 height = swar_decimal(t + sign, digits);
+          push_height(rows, t[0] == '-' ? -height : height, 0);
         }
-        south_conn->x = (x - (y + 1)) * offset_x + origin->x;
-        south_conn->y = (x + (y + 1)) * offset_y -
-                        fdf->buf[y + 1][x] * height_scale + origin->y;
+        if (!newlines)
+          break;
+        end_row(rows);
+        starts &= ~row;
+        newlines &= newlines - 1;
       }
+    } else {
+      for (u64 events = starts | block.newline; events; events &= events - 1) {
+        u32 pos = __builtin_ctzll(events);
+        if (block.newline >> pos & 1)
+          end_row(rows);
+        else
+          parse_token(p, end, &block, sep, pos, rows);
+      }
+    }
+    p += last + 1;
+  }
+  *state = local;
+  return p;
+}
+#endif
 
-      iso_point_t p = {
-          .pos = pos, .east_conn = east_conn, .south_conn = south_conn};
-
-      // io_printf("initial pos: pos(%d,%d,%d) of fdf\n", x, y, fdf->buf[y][x]);
-      points[points_cursor] = p;
-      ++points_cursor;
+// parses the rows of [p, end) into `heights` (and `colors` if not NULL),
+// padding them up to `width`
+void parse_rows(const char *p, const char *end, i32 *heights, u32 *colors,
+                u32 width) {
+  rows_t rows = {heights, colors, heights, width};
+#if defined(__SSE2__)
+  p = parse_blocks(p, end, &rows);
+#endif
+  while (p < end) {
+    if (*p == '\n') {
+      end_row(&rows);
+      ++p;
+    } else if (*p == ' ' || *p == '\t' || *p == '\r') {
+      ++p;
+    } else {
+      u32 color;
+      i32 height = parse_height(&p, end, &color);
+      push_height(&rows, height, color);
     }
   }
-  return points;
+  end_row(&rows);
 }
 
-typedef struct s_vars {
-  mlx_t *mlx;
-  mlx_image_t *img;
+// loads a map on its own thread, handing it out as soon as it is allocated
+// and then publishing how many of its rows are parsed, always a prefix of
+// the map, so that it can be drawn while still loading
+typedef struct loader_s {
+  pthread_t thread;
+  char *path;
+  char *cache_dir;
+  pthread_mutex_t lock;
+  pthread_cond_t progress;
+  // set once allocated, with `len` its final size
   fdfmap_t *fdf;
-  int height_scale;
-  u32 offset_x;
-  u32 offset_y;
-  vec2 *origin;
-} vars_t;
+  bool failed;
+  bool done;
+  atomic_uint rows_ready;
+  atomic_bool stop;
+  // built after the whole map is published, for the main thread to attach
+  // to it while nothing else reads the map
+  pyramid_t *pyramid;
+} loader_t;
+
+// the text is split in chunks starting right after a newline, measured then
+// parsed in parallel, each chunk knowing its first row from a prefix sum of
+// the row counts
+typedef struct parse_s {
+  u32 chunks;
+  // chunk c is [bounds[c], bounds[c + 1])
+  const char **bounds;
+  shape_t *shapes;
+  // first row of each chunk
+  u32 *rows;
+  i32 *heights;
+  u32 *colors;
+  u32 width;
+  u32 len;
+  // with a loader, parsed chunks and how many of them are published
+  loader_t *loader;
+  bool *parsed;
+  u32 published;
+} parse_t;
 
-void redraw(vars_t *vars) {
-  iso_point_t *points = iso_points(vars->fdf, vars->offset_x, vars->offset_y,
-                                   vars->origin, vars->height_scale);
-  clear_image(vars->img, 0x3333333f);
+// hands the allocated but not yet parsed map to whoever waits on the loader
+void publish_map(loader_t *loader, fdfmap_t *fdf) {
+  pthread_mutex_lock(&loader->lock);
+  loader->fdf = fdf;
+  pthread_cond_broadcast(&loader->progress);
+  pthread_mutex_unlock(&loader->lock);
+}
 
-  io_printf("redrawing!\n");
+// hands the pyramid over to the map once built, the caller making sure
+// nothing is reading the map meanwhile
+void attach_pyramid(loader_t *loader, fdfmap_t *fdf) {
+  pthread_mutex_lock(&loader->lock);
+  if (loader->pyramid) {
+    fdf->pyramid = loader->pyramid;
+    loader->pyramid = NULL;
+  }
+  pthread_mutex_unlock(&loader->lock);
+}
+
+void publish_rows(loader_t *loader, u32 rows) {
+  atomic_store_explicit(&loader->rows_ready, rows, memory_order_release);
+  pthread_cond_broadcast(&loader->progress);
+}
+
+// chunks finish in any order, the rows published only grow over the chunks
+// parsed in a row from the first one
+void publish_chunk(parse_t *parse, u32 c) {
+  loader_t *loader = parse->loader;
+  pthread_mutex_lock(&loader->lock);
+  parse->parsed[c] = true;
+  while (parse->published < parse->chunks && parse->parsed[parse->published])
+    ++parse->published;
+  publish_rows(loader, parse->published < parse->chunks
+                           ? parse->rows[parse->published]
+                           : parse->len);
+  pthread_mutex_unlock(&loader->lock);
+}
+
+void measure_task(void *ctx, u32 c) {
+  parse_t *parse = ctx;
+  if (!measure_rows(parse->bounds[c], parse->bounds[c + 1], &parse->shapes[c]))
+    parse->shapes[c].len = UINT32_MAX;
+}
+
+void parse_task(void *ctx, u32 c) {
+  parse_t *parse = ctx;
+  if (parse->loader && atomic_load(&parse->loader->stop))
+    return;
+  size_t first = (size_t)parse->rows[c] * parse->width;
+  parse_rows(parse->bounds[c], parse->bounds[c + 1], parse->heights + first,
+             parse->colors ? parse->colors + first : NULL, parse->width);
+  if (parse->loader)
+    publish_chunk(parse, c);
+}
 
-  for (u32 i = 0; i < vars->fdf->width * vars->fdf->len; ++i) {
-    if (points[i].pos->x < 0 || points[i].pos->y < 0 ||
-        points[i].pos->x >= WIN_WIDTH || points[i].pos->y >= WIN_HEIGHT) {
-      io_printf("skipping point of pos(%d,%d) -> out of bound\n",
-                points[i].pos->x, points[i].pos->y);
+// splits the text in `chunks` pieces cut after newlines, returns how many
+// non-empty ones came out
+u32 split_chunks(const char *data, const char *end, const char **bounds,
+                 u32 chunks) {
+  size_t size = end - data;
+  u32 count = 0;
+  bounds[0] = data;
+  for (u32 c = 1; c < chunks; ++c) {
+    const char *cut = data + size / chunks * c;
+    if (cut < bounds[count])
       continue;
-    }
-    Color red = {0xff, 0x00, 0x00, 0xff};
-    draw_circle(vars->img, points[i].pos, 2, &red);
-    if (points[i].east_conn)
-      draw_line(vars->img, points[i].pos, points[i].east_conn, 0xffffffff);
-    if (points[i].south_conn)
-      draw_line(vars->img, points[i].pos, points[i].south_conn, 0xffffffff);
+    const char *nl = memchr(cut, '\n', end - cut);
+    if (!nl || nl + 1 >= end)
+      break;
+    bounds[++count] = nl + 1;
   }
-  clean_iso_points(points, vars->fdf->len * vars->fdf->width);
+  bounds[++count] = end;
+  return count;
 }
 
-void key_handler(mlx_key_data_t keydata, void *param) {
-  vars_t *vars = (vars_t *)param;
-  if (keydata.key == MLX_KEY_UP && keydata.action == MLX_PRESS) {
-    io_printf("key_up event!\n");
-    if (vars->height_scale + 1 < 30)
-      vars->height_scale += 1;
-    redraw(vars);
-  } else if (keydata.key == MLX_KEY_DOWN && keydata.action == MLX_PRESS) {
-    io_printf("key_down event!\n");
-    if (vars->height_scale - 1 > -10)
-      vars->height_scale -= 1;
-    redraw(vars);
-  } else if (keydata.key == MLX_KEY_ESCAPE && keydata.action == MLX_PRESS) {
-    mlx_close_window(vars->mlx);
+// sums the chunk shapes into `shape` and turns them into first rows
+bool merge_shapes(parse_t *parse, shape_t *shape) {
+  *shape = (shape_t){0, UINT32_MAX, 0, false};
+  u64 rows = 0;
+  for (u32 c = 0; c < parse->chunks; ++c) {
+    shape_t *chunk = &parse->shapes[c];
+    parse->rows[c] = rows;
+    rows += chunk->len;
+    if (rows > UINT32_MAX)
+      return false;
+    if (chunk->len && chunk->min_width < shape->min_width)
+      shape->min_width = chunk->min_width;
+    if (chunk->max_width > shape->max_width)
+      shape->max_width = chunk->max_width;
+    shape->colored |= chunk->colored;
   }
+  shape->len = rows;
+  return true;
 }
 
-int main(int argc, char **argv) {
-  io_printf("Startup of fdf...\n");
-  // load  of file from args
-  if (argc < 2) {
-    io_printf("error: missing fdf file as argument, exiting...\n");
-    return 1;
+void free_parse(parse_t *parse) {
+  free(parse->bounds);
+  free(parse->shapes);
+  free(parse->rows);
+  free(parse->parsed);
+}
+
+// parses the text map held by `data` on up to `threads` threads, 0 meaning
+// one per core. With a `loader`, the map is published before being parsed
+fdfmap_t *parse_fdf(const char *data, size_t size, char *fdf_path,
+                    u32 threads, loader_t *loader) {
+  const char *end = data + size;
+  u32 chunks = size / PARSE_CHUNK_MIN ? size / PARSE_CHUNK_MIN : 1;
+  parse_t parse = {.bounds = malloc(sizeof(char *) * (chunks + 1)),
+                   .shapes = malloc(sizeof(shape_t) * chunks),
+                   .rows = malloc(sizeof(u32) * chunks),
+                   .parsed = calloc(chunks, sizeof(bool)),
+                   .loader = loader};
+  if (!parse.bounds || !parse.shapes || !parse.rows || !parse.parsed) {
+    io_printf("error: could not malloc for buf of fdf\n");
+    free_parse(&parse);
+    return NULL;
   }
+  parse.chunks = split_chunks(data, end, parse.bounds, chunks);
+  pool_t *pool = parse.chunks > 1 ? new_pool(threads) : NULL;
 
-  char *fdf_path = argv[1];
-  int fdf_file = open(fdf_path, O_RDONLY);
-  if (fdf_file < 0) {
-    io_printf(
-        "error: fdf file path provided does not exist, check path: `%s`\n",
-        fdf_path);
-    return 1;
+  // the map is measured up front, so the whole grid is a single exactly
+  // sized allocation
+  pool_run(pool, measure_task, &parse, parse.chunks);
+  shape_t shape;
+  if (!merge_shapes(&parse, &shape) ||
+      (u64)shape.len * shape.max_width > MAX_MAP_CELLS) {
+    io_printf("error: `%s` is too large\n", fdf_path);
+    free_pool(pool);
+    free_parse(&parse);
+    return NULL;
+  }
+  u32 len = shape.len;
+  u32 width = shape.max_width;
+  if (!len || !width) {
+    io_printf("error: `%s` holds no heights\n", fdf_path);
+    free_pool(pool);
+    free_parse(&parse);
+    return NULL;
+  }
+  if (shape.min_width != width)
+    io_printf("warning: `%s` has rows of %d to %d heights, padding them "
+              "with zeros\n",
+              fdf_path, shape.min_width, width);
+  fdfmap_t *fdf = malloc(sizeof(fdfmap_t));
+  i32 *heights = malloc(sizeof(i32) * width * len);
+  u32 *colors = NULL;
+  if (shape.colored)
+    colors = malloc(sizeof(u32) * width * len);
+  if (!fdf || !heights || (shape.colored && !colors)) {
+    io_printf("error: could not malloc for buf of fdf\n");
+    free(fdf);
+    free(heights);
+    free(colors);
+    free_pool(pool);
+    free_parse(&parse);
+    return NULL;
   }
+  *fdf = (fdfmap_t){.heights = heights,
+                    .colors = colors,
+                    .len = len,
+                    .width = width,
+                    .stride = width};
+  if (loader)
+    publish_map(loader, fdf);
 
-  // load fdf into a buffer
-  fdfmap_t *fdf = load_fdf(fdf_file, fdf_path);
+  parse.heights = heights;
+  parse.colors = colors;
+  parse.width = width;
+  parse.len = len;
+  pool_run(pool, parse_task, &parse, parse.chunks);
+  free_pool(pool);
+  free_parse(&parse);
+  return fdf;
+}
+
+// binary maps (.fdfb) start with this header, followed by the heights plane
+// and, if has_colors, the colors plane, both row-major without padding and
+// starting at FDFB_ALIGN aligned offsets. Fields are in host byte order
+#define FDFB_MAGIC "FDFB"
+#define FDFB_VERSION 1
+#define FDFB_ALIGN 64
+#define FDFB_I32 1
+
+typedef struct fdfb_header_s {
+  char magic[4];
+  u32 version;
+  u32 width;
+  u32 len;
+  // FDFB_I32, the only height type so far
+  u32 height_type;
+  i32 min_height;
+  i32 max_height;
+  u32 has_colors;
+  // size, mtime (ns) and FNV-1a hash of the text map it was made from
+  u64 source_size;
+  i64 source_mtime;
+  u64 source_hash;
+  u64 heights_offset;
+  u64 colors_offset;
+} fdfb_header_t;
+
+// 64 bit FNV-1a of `size` bytes, chained through `hash`
+u64 fnv1a(const void *data, size_t size, u64 hash) {
+  const u8 *p = data;
+  for (size_t i = 0; i < size; ++i)
+    hash = (hash ^ p[i]) * 0x100000001b3ull;
+  return hash;
+}
+
+#define FNV1A_INIT 0xcbf29ce484222325ull
+
+bool is_fdfb(const void *data, size_t size) {
+  return size >= sizeof(fdfb_header_t) && !memcmp(data, FDFB_MAGIC, 4);
+}
+
+// wraps a mapped .fdfb file without copying, the map then owns the mapping
+fdfmap_t *map_fdfb(void *data, size_t size, char *fdf_path) {
+  const fdfb_header_t *header = data;
+  u64 cells = (u64)header->width * header->len;
+  u64 plane = cells * sizeof(i32);
+  if (header->version != FDFB_VERSION || header->height_type != FDFB_I32 ||
+      !cells || cells > MAX_MAP_CELLS ||
+      header->heights_offset % FDFB_ALIGN ||
+      header->heights_offset > size || plane > size - header->heights_offset ||
+      (header->has_colors &&
+       (header->colors_offset % FDFB_ALIGN ||
+        header->colors_offset > size ||
+        plane > size - header->colors_offset))) {
+    io_printf("error: `%s` is not a valid version %d fdfb file\n", fdf_path,
+              FDFB_VERSION);
+    return NULL;
+  }
+  fdfmap_t *fdf = malloc(sizeof(fdfmap_t));
   if (!fdf) {
-    io_printf("fatal: failed to load `%s` into memory, exiting\n");
+    io_printf("error: could not malloc for buf of fdf\n");
+    return NULL;
   }
-  io_printf("closing fd\n", fdf_path);
-  close(fdf_file);
+  u8 *base = data;
+  *fdf = (fdfmap_t){
+      .heights = (i32 *)(base + header->heights_offset),
+      .colors = header->has_colors ? (u32 *)(base + header->colors_offset)
+                                   : NULL,
+      .len = header->len,
+      .width = header->width,
+      .stride = header->width,
+      .mapping = data,
+      .mapping_size = size};
+  return fdf;
+}
 
-  //////////////////////
-  /// graphical part ///
-  //////////////////////
+bool write_all(int fd, const void *data, size_t size) {
+  const u8 *p = data;
+  while (size) {
+    ssize_t n = write(fd, p, size);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
 
-  // start window
-  io_printf("initializing mlx_window...");
-  mlx_t *mlx = mlx_init(WIN_WIDTH, WIN_HEIGHT, "fdf", 0);
-  if (!mlx)
-    return 1;
-  io_printf("success\n");
+// pads the file up to the next FDFB_ALIGN boundary
+bool write_padding(int fd, u64 *offset) {
+  const u8 zeros[FDFB_ALIGN] = {0};
+  u64 pad = (FDFB_ALIGN - *offset % FDFB_ALIGN) % FDFB_ALIGN;
+  *offset += pad;
+  return write_all(fd, zeros, pad);
+}
 
-  mlx_image_t *img = mlx_new_image(mlx, WIN_WIDTH, WIN_HEIGHT);
-  if (!img || (mlx_image_to_window(mlx, img, 0, 0)) < 0)
+// writes `fdf` as a .fdfb file, `header` bringing the source fields.
+// Returns 0 on success
+int write_fdfb(fdfmap_t *fdf, fdfb_header_t *header, const char *path) {
+  size_t cells = (size_t)fdf->width * fdf->len;
+  memcpy(header->magic, FDFB_MAGIC, 4);
+  header->version = FDFB_VERSION;
+  header->width = fdf->width;
+  header->len = fdf->len;
+  header->height_type = FDFB_I32;
+  header->has_colors = fdf->colors != NULL;
+  header->min_height = INT_MAX;
+  header->max_height = INT_MIN;
+  for (u32 y = 0; y < fdf->len; ++y) {
+    const i32 *row = fdf->heights + (size_t)y * fdf->stride;
+    for (u32 x = 0; x < fdf->width; ++x) {
+      header->min_height = row[x] < header->min_height ? row[x]
+                                                       : header->min_height;
+      header->max_height = row[x] > header->max_height ? row[x]
+                                                       : header->max_height;
+    }
+  }
+  u64 offset = sizeof(fdfb_header_t);
+  header->heights_offset = (offset + FDFB_ALIGN - 1) / FDFB_ALIGN * FDFB_ALIGN;
+  header->colors_offset = 0;
+  if (fdf->colors)
+    header->colors_offset =
+        (header->heights_offset + cells * sizeof(i32) + FDFB_ALIGN - 1) /
+        FDFB_ALIGN * FDFB_ALIGN;
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
     return 1;
+  bool ok = write_all(fd, header, sizeof(fdfb_header_t)) &&
+            write_padding(fd, &offset);
+  for (u32 y = 0; ok && y < fdf->len; ++y)
+    ok = write_all(fd, fdf->heights + (size_t)y * fdf->stride,
+                   sizeof(i32) * fdf->width);
+  offset += cells * sizeof(i32);
+  if (ok && fdf->colors) {
+    ok = write_padding(fd, &offset);
+    for (u32 y = 0; ok && y < fdf->len; ++y)
+      ok = write_all(fd, fdf->colors + (size_t)y * fdf->stride,
+                     sizeof(u32) * fdf->width);
+  }
+  return (close(fd) < 0 || !ok);
+}
 
-  // offset for scaling in the window
-  i32 h_offset = WIN_WIDTH / fdf->width;
-  i32 v_offset = WIN_HEIGHT / fdf->len;
-  i32 offset = h_offset > v_offset ? v_offset : h_offset;
-  if (offset < 5)
-    offset = 5;
-
-  // draw_buf(img, fdf, offset);
-  vec2 iso_center = {WIN_WIDTH / 2, WIN_HEIGHT / 3};
-  i32 height_scale = 1;
-  iso_point_t *points =
-      iso_points(fdf, h_offset / 4, v_offset / 4, &iso_center, height_scale);
-
-  // draw points
-  for (u32 i = 0; i < fdf->width * fdf->len; ++i) {
-    if (points[i].pos->x < 0 || points[i].pos->y < 0 ||
-        points[i].pos->x >= WIN_WIDTH || points[i].pos->y >= WIN_HEIGHT) {
-      io_printf("skipping point of pos(%d,%d) -> out of bound\n",
-                points[i].pos->x, points[i].pos->y);
+i64 mtime_ns(struct stat *st) {
+  return st->st_mtim.tv_sec * 1000000000ll + st->st_mtim.tv_nsec;
+}
+
+i64 ctime_ns(struct stat *st) {
+  return st->st_ctim.tv_sec * 1000000000ll + st->st_ctim.tv_nsec;
+}
+
+// writes the 16 lowercase hex digits of `n` at `out`
+void hex_u64(char *out, u64 n) {
+  for (int i = 15; i >= 0; --i, n >>= 4)
+    out[i] = "0123456789abcdef"[n & 0xf];
+}
+
+// like mkdir -p, `path` is restored before returning
+bool make_dirs(char *path) {
+  for (char *p = path + 1;; ++p) {
+    if (*p != '/' && *p)
       continue;
-    }
-    Color red = {0xff, 0x00, 0x00, 0xff};
-    draw_circle(img, points[i].pos, 2, &red);
-    if (points[i].east_conn)
-      draw_line(img, points[i].pos, points[i].east_conn, 0xffffffff);
-    if (points[i].south_conn)
-      draw_line(img, points[i].pos, points[i].south_conn, 0xffffffff);
+    char c = *p;
+    *p = '\0';
+    bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+    *p = c;
+    if (!ok || !c)
+      return ok;
   }
-  clean_iso_points(points, fdf->len * fdf->width);
+}
 
-  io_printf("starting mlx loop\n");
-  vars_t vars = {mlx,          img,          fdf,        height_scale,
-                 h_offset / 4, v_offset / 4, &iso_center};
+// --cache-dir, else $XDG_CACHE_HOME/fdf, else ~/.cache/fdf, NULL if none of
+// them is known. The result is malloc'd
+char *cache_dir_path(char *option) {
+  if (option)
+    return strdup(option);
+  char *base = getenv("XDG_CACHE_HOME");
+  char *suffix = "/fdf";
+  if (!base || !*base) {
+    base = getenv("HOME");
+    suffix = "/.cache/fdf";
+  }
+  if (!base || !*base)
+    return NULL;
+  char *dir = malloc(strlen(base) + strlen(suffix) + 1);
+  if (dir) {
+    strcpy(dir, base);
+    strcat(dir, suffix);
+  }
+  return dir;
+}
+
+// cache entries are .fdfb files named after the source's canonical path
+// only, so a changed source overwrites its own entry
+char *cache_file_path(const char *cache_dir, char *fdf_path) {
+  char *real = realpath(fdf_path, NULL);
+  const char *key_path = real ? real : fdf_path;
+  u64 hash = fnv1a(key_path, strlen(key_path), FNV1A_INIT);
+  free(real);
+
+  size_t dir_len = strlen(cache_dir);
+  char *path = malloc(dir_len + 1 + 16 + sizeof(".fdfb"));
+  if (!path)
+    return NULL;
+  memcpy(path, cache_dir, dir_len);
+  path[dir_len] = '/';
+  hex_u64(path + dir_len + 1, hash);
+  memcpy(path + dir_len + 17, ".fdfb", sizeof(".fdfb"));
+  return path;
+}
 
+// maps the cache entry at `path` if it was made from `source`, described
+// by `st`. Rehashing the source would cost more than parsing a small one,
+// so only sources whose ctime is not older than the entry get rehashed:
+// writing them in any way, even keeping their size and mtime, bumps it.
+// A matching hash then touches the entry, later loads skip the rehash
+fdfmap_t *load_cached(char *path, const char *source, struct stat *st) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat cst;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &cst) == 0 && cst.st_size > 0)
+    data = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  const fdfb_header_t *header = data;
+  bool fresh = data != MAP_FAILED && is_fdfb(data, cst.st_size) &&
+               header->version == FDFB_VERSION &&
+               header->source_size == (u64)st->st_size &&
+               header->source_mtime == mtime_ns(st);
+  if (fresh && ctime_ns(st) >= mtime_ns(&cst)) {
+    fresh = header->source_hash == fnv1a(source, st->st_size, FNV1A_INIT);
+    if (fresh)
+      futimens(fd, NULL);
+  }
+  close(fd);
+  fdfmap_t *fdf = fresh ? map_fdfb(data, cst.st_size, path) : NULL;
+  if (fdf)
+    madvise(data, cst.st_size, MADV_WILLNEED);
+  else if (data != MAP_FAILED)
+    munmap(data, cst.st_size);
+  return fdf;
+}
+
+// writes the cache entry through a temporary file renamed over `path`, so
+// concurrent readers only ever see complete entries
+void store_cached(fdfmap_t *fdf, const char *data, struct stat *st,
+                  char *path) {
+  char *slash = strrchr(path, '/');
+  size_t len = strlen(path);
+  char *tmp = malloc(len + 1 + 16 + sizeof(".tmp"));
+  if (!tmp)
+    return;
+  memcpy(tmp, path, len);
+  tmp[len] = '.';
+  hex_u64(tmp + len + 1, getpid());
+  memcpy(tmp + len + 17, ".tmp", sizeof(".tmp"));
+
+  *slash = '\0';
+  bool ok = make_dirs(path);
+  *slash = '/';
+  fdfb_header_t header = {.source_size = st->st_size,
+                          .source_mtime = mtime_ns(st),
+                          .source_hash = fnv1a(data, st->st_size, FNV1A_INIT)};
+  if (ok && write_fdfb(fdf, &header, tmp) == 0 && rename(tmp, path) == 0) {
+    free(tmp);
+    return;
+  }
+  io_printf("warning: could not write cache file `%s`\n", path);
+  unlink(tmp);
+  free(tmp);
+}
+
+// loads either a text or a binary map from `fd`. Text maps go through the
+// cache in `cache_dir`, if not NULL, and are published to `loader`, if not
+// NULL, while being parsed
+fdfmap_t *load_fdf(int fd, char *fdf_path, const char *cache_dir,
+                   loader_t *loader) {
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    io_printf("error: could not stat `%s` or file is empty\n", fdf_path);
+    return NULL;
+  }
+  size_t size = st.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    io_printf("error: could not mmap `%s`\n", fdf_path);
+    return NULL;
+  }
+  if (is_fdfb(data, size)) {
+    madvise(data, size, MADV_WILLNEED);
+    fdfmap_t *fdf = map_fdfb(data, size, fdf_path);
+    if (!fdf)
+      munmap(data, size);
+    return fdf;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+  char *cache_path = cache_dir ? cache_file_path(cache_dir, fdf_path) : NULL;
+  fdfmap_t *fdf = cache_path ? load_cached(cache_path, data, &st) : NULL;
+  if (!fdf) {
+    fdf = parse_fdf(data, size, fdf_path, 0, loader);
+    // a stopped loader leaves the map half parsed
+    if (fdf && cache_path && !(loader && atomic_load(&loader->stop)))
+      store_cached(fdf, data, &st, cache_path);
+  }
+  free(cache_path);
+  munmap(data, size);
+  return fdf;
+}
+
+// `fdf --convert in.fdf out.fdfb`
+int run_convert(char *in_path, char *out_path) {
+  int fd = open(in_path, O_RDONLY);
+  if (fd < 0) {
+    io_printf("error: could not open `%s`\n", in_path);
+    return 1;
+  }
+  struct stat st;
+  char *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    io_printf("error: could not mmap `%s`\n", in_path);
+    return 1;
+  }
+  if (is_fdfb(data, st.st_size)) {
+    io_printf("error: `%s` already is a binary map\n", in_path);
+    munmap(data, st.st_size);
+    return 1;
+  }
+  fdfb_header_t header = {
+      .source_size = st.st_size,
+      .source_mtime = mtime_ns(&st),
+      .source_hash = fnv1a(data, st.st_size, FNV1A_INIT)};
+  fdfmap_t *fdf = parse_fdf(data, st.st_size, in_path, 0, NULL);
+  munmap(data, st.st_size);
+  if (!fdf)
+    return 1;
+  int ret = write_fdfb(fdf, &header, out_path);
+  if (ret)
+    io_printf("error: could not write `%s`\n", out_path);
+  else
+    io_printf("wrote `%s`\n", out_path);
+  free_fdf(fdf);
+  return ret;
+}
+
+u8 normalize_hex(u32 hex) {
+  if (hex > 0xff) {
+    return 0xff;
+  }
+  return hex;
+}
+
+void draw_buf(mlx_image_t *img, fdfmap_t *fdf, u32 offset) {
+
+  vec2 start = {(WIN_WIDTH - (fdf->width * offset)) / 2,
+                (WIN_HEIGHT - (fdf->len * offset)) / 2};
+
+  if (start.x < 0 || start.x > WIN_WIDTH) {
+    start.x = 0;
+    offset = 2;
+  }
+  if (start.y < 0 || start.y > WIN_HEIGHT) {
+    start.y = 0;
+    offset = 2;
+  }
+
+  io_printf("start(%d, %d)\n", start.x, start.y);
+
+  for (u32 i = 0; i < fdf->len; ++i) {
+    const i32 *row = fdf->heights + (size_t)i * fdf->stride;
+    for (u32 j = 0; j < fdf->width; ++j) {
+      vec2 pos = {start.x + j * offset, start.y + i * offset};
+      if (pos.x < 0 || pos.x >= (i32)WIN_WIDTH || pos.y < 0 ||
+          pos.y >= (i32)WIN_HEIGHT)
+        continue;
+
+      Color c = {normalize_hex(0x66 + row[j] * COLOR_SCALE),
+                 normalize_hex(0x88 + row[j] * COLOR_SCALE),
+                 normalize_hex(0x33 + row[j] * COLOR_SCALE), 0xff};
+
+      // io_printf("Color: (%x, %x, %x, %x)\n", c.r, c.g, c.b, c.a);
+      draw_square(img, &pos, offset / 1.8, &c);
+    }
+  }
+}
+
+// screen space level of detail: when the map's cells would project below a
+// pixel, every stride x stride block of it is reduced to a single vertex,
+// stride being the smallest power of two keeping the window offsets at
+// least a pixel. A block keeps whichever of its lowest and highest heights
+// is the farthest from 0, so peaks and pits survive the decimation
+typedef struct lod_s {
+  fdfmap_t map;
+  u32 stride;
+  // rows of the source map whose blocks are complete in `map`
+  u32 rows;
+} lod_t;
+
+u32 lod_stride(u32 width, u32 len, u32 img_width, u32 img_height) {
+  u32 stride = 1;
+  while (stride < (1u << 31) &&
+         ((u64)(width + stride - 1) / stride * 4 > img_width ||
+          (u64)(len + stride - 1) / stride * 4 > img_height))
+    stride *= 2;
+  return stride;
+}
+
+void free_lod(lod_t *lod) {
+  free(lod->map.heights);
+  free(lod->map.colors);
+  *lod = (lod_t){0};
+}
+
+bool new_lod(lod_t *lod, fdfmap_t *fdf, u32 stride) {
+  u32 width = (fdf->width + stride - 1) / stride;
+  u32 len = (fdf->len + stride - 1) / stride;
+  *lod = (lod_t){.map = {.heights = malloc(sizeof(i32) * width * len),
+                         .colors = fdf->colors
+                                       ? malloc(sizeof(u32) * width * len)
+                                       : NULL,
+                         .len = len,
+                         .width = width,
+                         .stride = width},
+                 .stride = stride};
+  if (!lod->map.heights || (fdf->colors && !lod->map.colors)) {
+    free_lod(lod);
+    return false;
+  }
+  return true;
+}
+
+// reduces block (bx, by) of the first `rows` rows of `fdf`
+void lod_block(lod_t *lod, fdfmap_t *fdf, u32 rows, u32 bx, u32 by) {
+  u32 k = lod->stride;
+  u32 x1 = bx * k + k < fdf->width ? bx * k + k : fdf->width;
+  u32 y1 = by * k + k < rows ? by * k + k : rows;
+  size_t min_at = (size_t)by * k * fdf->stride + bx * k;
+  size_t max_at = min_at;
+  for (u32 y = by * k; y < y1; ++y) {
+    const i32 *row = fdf->heights + (size_t)y * fdf->stride;
+    for (u32 x = bx * k; x < x1; ++x) {
+      if (row[x] < fdf->heights[min_at])
+        min_at = (size_t)y * fdf->stride + x;
+      if (row[x] > fdf->heights[max_at])
+        max_at = (size_t)y * fdf->stride + x;
+    }
+  }
+  i64 min = fdf->heights[min_at];
+  i64 max = fdf->heights[max_at];
+  size_t at = -min > max ? min_at : max_at;
+  size_t i = (size_t)by * lod->map.stride + bx;
+  lod->map.heights[i] = fdf->heights[at];
+  if (lod->map.colors)
+    lod->map.colors[i] = fdf->colors[at];
+}
+
+// brings the decimated map up to the first `rows` rows of `fdf`, only
+// reducing what it does not hold yet. Returns how many of its rows are
+// ready, the last one possibly from an incomplete block
+u32 lod_reduce(lod_t *lod, fdfmap_t *fdf, u32 rows) {
+  u32 k = lod->stride;
+  if (lod->rows == rows)
+    return (rows + k - 1) / k;
+  // uncolored blocks are read off the pyramid, which only exists once the
+  // whole map is loaded
+  u32 level = __builtin_ctz(k);
+  pyramid_t *pyramid = !fdf->colors && fdf->pyramid &&
+                               level <= fdf->pyramid->levels
+                           ? fdf->pyramid
+                           : NULL;
+  for (u32 by = lod->rows / k; by * k < rows; ++by) {
+    for (u32 bx = 0; bx < lod->map.width; ++bx) {
+      if (pyramid)
+        lod->map.heights[(size_t)by * lod->map.stride + bx] =
+            minmax_height(pyramid_block(pyramid, level, bx, by));
+      else
+        lod_block(lod, fdf, rows, bx, by);
+    }
+  }
+  // a block short of rows is reduced again once they are loaded
+  lod->rows = rows == fdf->len ? rows : rows / k * k;
+  return (rows + k - 1) / k;
+}
+
+typedef struct mesh_s mesh_t;
+
+// projected screen position of every grid vertex, stored as separate x and
+// y planes in the same row-major order as fdfmap_t. Edges are implied by
+// grid adjacency: vertex i connects east to i + 1 and south to i + width
+// y is kept as two terms: base_y holds the part that only depends on the
+// grid position, so a height scale change is one multiply-add per vertex
+typedef struct proj_s {
+  i32 *x;
+  i32 *y;
+  i32 *base_y;
+  u32 width;
+  u32 len;
+  // the map's color plane and its row stride, NULL for uncolored maps
+  const u32 *colors;
+  u32 colors_stride;
+  // bounding box of every projected vertex, kept up to date by iso_base and
+  // iso_heights
+  rect_t bounds;
+  // CULL_* flags of every block of vertices, see cull_blocks
+  u8 *blocks;
+  u32 blocks_x;
+  u32 blocks_y;
+  // simplified mesh drawn instead of the grid, NULL to draw the grid
+  const mesh_t *mesh;
+} proj_t;
+
+// vertices are culled in blocks of 2^CULL_LEVEL x 2^CULL_LEVEL. Only the
+// vertices of visible blocks are drawn, and only those of the blocks with
+// their edges' ends are projected
+#define CULL_LEVEL 5
+#define CULL_VISIBLE 0x1
+#define CULL_PROJECTED 0x2
+// base_y and x are up to date
+#define CULL_BASED 0x4
+
+void free_proj(proj_t *proj) {
+  if (!proj)
+    return;
+  free(proj->x);
+  free(proj->y);
+  free(proj->base_y);
+  free(proj->blocks);
+  free(proj);
+}
+
+proj_t *new_proj(u32 width, u32 len) {
+  proj_t *proj = malloc(sizeof(proj_t));
+  if (!proj)
+    return NULL;
+  proj->width = width;
+  proj->len = len;
+  proj->mesh = NULL;
+  proj->x = malloc(sizeof(i32) * width * len);
+  proj->y = malloc(sizeof(i32) * width * len);
+  proj->base_y = malloc(sizeof(i32) * width * len);
+  proj->blocks_x = (width + (1u << CULL_LEVEL) - 1) >> CULL_LEVEL;
+  proj->blocks_y = (len + (1u << CULL_LEVEL) - 1) >> CULL_LEVEL;
+  proj->blocks = calloc((size_t)proj->blocks_x * proj->blocks_y, 1);
+  if (!proj->x || !proj->y || !proj->base_y || !proj->blocks) {
+    free_proj(proj);
+    return NULL;
+  }
+  return proj;
+}
+
+u8 block_flags(proj_t *proj, u32 x, u32 y) {
+  return proj->blocks[(y >> CULL_LEVEL) * proj->blocks_x + (x >> CULL_LEVEL)];
+}
+
+// end of the block span of row y holding column x
+u32 block_end(proj_t *proj, u32 x) {
+  u32 end = ((x >> CULL_LEVEL) + 1) << CULL_LEVEL;
+  return end < proj->width ? end : proj->width;
+}
+
+// first vertex from i on, in row-major order, of a visible block, n if none
+u32 next_visible(proj_t *proj, u32 i, u32 n) {
+  while (i < n) {
+    u32 x = i % proj->width;
+    u32 y = i / proj->width;
+    if (block_flags(proj, x, y) & CULL_VISIBLE)
+      return i;
+    i = y * proj->width + block_end(proj, x);
+  }
+  return n;
+}
+
+// flags the blocks of vertices that may draw inside `viewport`. The screen
+// box of a block's vertices and of the ends of their edges, on the blocks
+// east, south and south east of it, is bounded using the heights of the
+// four blocks as given by `level` of the pyramid, the one whose blocks
+// match the culled ones. Blocks stay visible when there is no such pyramid
+void cull_blocks(proj_t *proj, const pyramid_t *pyramid, u32 level,
+                 u32 offset_x, u32 offset_y, vec2 *origin, i32 height_scale,
+                 rect_t *viewport) {
+  if (pyramid && (level > pyramid->levels ||
+                  pyramid->widths[level - 1] != proj->blocks_x ||
+                  pyramid->lens[level - 1] != proj->blocks_y))
+    pyramid = NULL;
+  u32 side = 1u << CULL_LEVEL;
+  for (u32 by = 0; by < proj->blocks_y; ++by) {
+    for (u32 bx = 0; bx < proj->blocks_x; ++bx) {
+      u8 *flags = proj->blocks + by * proj->blocks_x + bx;
+      *flags &= CULL_BASED;
+      if (!pyramid) {
+        *flags |= CULL_VISIBLE;
+        continue;
+      }
+      minmax_t m = pyramid_block(pyramid, level, bx, by);
+      for (u32 k = 1; k < 4; ++k) {
+        u32 nx = bx + (k & 1);
+        u32 ny = by + (k >> 1);
+        if (nx >= proj->blocks_x || ny >= proj->blocks_y)
+          continue;
+        minmax_t n = pyramid_block(pyramid, level, nx, ny);
+        m.min = n.min < m.min ? n.min : m.min;
+        m.max = n.max > m.max ? n.max : m.max;
+      }
+      i64 lift0 = (i64)m.min * height_scale;
+      i64 lift1 = (i64)m.max * height_scale;
+      if (lift0 > lift1) {
+        i64 t = lift0;
+        lift0 = lift1;
+        lift1 = t;
+      }
+      i64 x0 = bx * side;
+      i64 y0 = by * side;
+      i64 x1 = x0 + side < proj->width ? x0 + side : proj->width - 1;
+      i64 y1 = y0 + side < proj->len ? y0 + side : proj->len - 1;
+      i64 r = POINT_RADIUS;
+      i64 sx0 = (x0 - y1) * offset_x + origin->x - r;
+      i64 sx1 = (x1 - y0) * offset_x + origin->x + r;
+      i64 sy0 = (x0 + y0) * offset_y + origin->y - lift1 - r;
+      i64 sy1 = (x1 + y1) * offset_y + origin->y - lift0 + r;
+      if (sx1 >= viewport->x0 && sx0 < viewport->x1 && sy1 >= viewport->y0 &&
+          sy0 < viewport->y1)
+        *flags |= CULL_VISIBLE;
+    }
+  }
+  // the far ends of edges are in the blocks east, south and south east
+  for (u32 by = 0; by < proj->blocks_y; ++by) {
+    for (u32 bx = 0; bx < proj->blocks_x; ++bx) {
+      u8 *flags = proj->blocks + by * proj->blocks_x + bx;
+      u8 *north = by ? flags - proj->blocks_x : NULL;
+      if ((*flags & CULL_VISIBLE) || (bx && (flags[-1] & CULL_VISIBLE)) ||
+          (north && (north[0] & CULL_VISIBLE)) ||
+          (north && bx && (north[-1] & CULL_VISIBLE)))
+        *flags |= CULL_PROJECTED;
+    }
+  }
+}
+
+// projects the height independent part of every vertex: screen x and the
+// base of screen y, for the projected blocks not already done
+void iso_base(fdfmap_t *fdf, u32 offset_x, u32 offset_y, vec2 *origin,
+              proj_t *proj) {
+  for (u32 y = 0; y < fdf->len; ++y) {
+    i32 *px = proj->x + y * proj->width;
+    i32 *pb = proj->base_y + y * proj->width;
+    for (u32 x0 = 0; x0 < fdf->width; x0 = block_end(proj, x0)) {
+      if ((block_flags(proj, x0, y) & (CULL_PROJECTED | CULL_BASED)) !=
+          CULL_PROJECTED)
+        continue;
+      u32 x1 = block_end(proj, x0);
+      for (u32 x = x0; x < x1; ++x) {
+        px[x] = (x - y) * offset_x + origin->x;
+        pb[x] = (x + y) * offset_y + origin->y;
+      }
+    }
+  }
+  for (u32 b = 0; b < proj->blocks_x * proj->blocks_y; ++b) {
+    if (proj->blocks[b] & CULL_PROJECTED)
+      proj->blocks[b] |= CULL_BASED;
+  }
+  proj->colors = fdf->colors;
+  proj->colors_stride = fdf->stride;
+  // x is extreme at the west (0, len - 1) and east (width - 1, 0) corners
+  proj->bounds.x0 = (0 - (i32)(fdf->len - 1)) * (i32)offset_x + origin->x;
+  proj->bounds.x1 = (i32)(fdf->width - 1) * (i32)offset_x + origin->x + 1;
+}
+
+// applies the height plane on top of base_y, the only pass needed when just
+// the height scale changed
+void iso_heights(fdfmap_t *fdf, i32 height_scale, proj_t *proj) {
+  i32 min_y = INT_MAX;
+  i32 max_y = INT_MIN;
+  for (u32 y = 0; y < fdf->len; ++y) {
+    const i32 *restrict row = fdf->heights + (size_t)y * fdf->stride;
+    const i32 *restrict pb = proj->base_y + y * proj->width;
+    i32 *restrict py = proj->y + y * proj->width;
+    for (u32 x0 = 0; x0 < fdf->width; x0 = block_end(proj, x0)) {
+      if (!(block_flags(proj, x0, y) & CULL_PROJECTED))
+        continue;
+      u32 x1 = block_end(proj, x0);
+      for (u32 x = x0; x < x1; ++x)
+        py[x] = pb[x] - row[x] * height_scale;
+      for (u32 x = x0; x < x1; ++x) {
+        min_y = py[x] < min_y ? py[x] : min_y;
+        max_y = py[x] > max_y ? py[x] : max_y;
+      }
+    }
+  }
+  proj->bounds.y0 = min_y;
+  proj->bounds.y1 = max_y + 1;
+}
+
+// draws vertex i, its circle then its east and south edges, restricted to
+// `clip`
+// vertices are red and their edges white, unless the map gives the vertex
+// a color, used for both
+void vertex_colors(proj_t *proj, u32 i, u32 *point, u32 *edges) {
+  *point = RED;
+  *edges = WHITE;
+  if (proj->colors) {
+    u32 color = proj->colors[(i / proj->width) * proj->colors_stride +
+                             i % proj->width];
+    if (color) {
+      *point = color;
+      *edges = color;
+    }
+  }
+}
+
+void draw_vertex(mlx_image_t *img, proj_t *proj, u32 i, rect_t *clip) {
+  u32 x = i % proj->width;
+  u32 point;
+  u32 edges;
+  vertex_colors(proj, i, &point, &edges);
+  Color c = hex_to_color(point);
+  vec2 pos = {proj->x[i], proj->y[i]};
+  draw_circle_clipped(img, &pos, POINT_RADIUS, &c, clip);
+  if (x + 1 < proj->width) {
+    vec2 east = {proj->x[i + 1], proj->y[i + 1]};
+    draw_line_clipped(img, &pos, &east, edges, clip);
+  }
+  if (i + proj->width < proj->width * proj->len) {
+    vec2 south = {proj->x[i + proj->width], proj->y[i + proj->width]};
+    draw_line_clipped(img, &pos, &south, edges, clip);
+  }
+}
+
+// right triangulated irregular network of the drawn map, which draws flat
+// and evenly sloped areas as a few large triangles. Every cull block is a
+// tile cut in two right triangles along its diagonal, a triangle being
+// split in two through the middle of its hypotenuse while the height there
+// strays from the hypotenuse by more than the tolerance. The grid is padded
+// to whole tiles: triangles sticking out of the map are always split, and
+// those left completely out of it skipped
+#define SIMPLIFY_TOLERANCE 1 // px
+// error forcing a split at any height scale
+#define MESH_SPLIT 0xffff
+
+typedef struct tri_s {
+  // a and b end the hypotenuse, c is the right angle
+  vec2 a;
+  vec2 b;
+  vec2 c;
+} tri_t;
+
+struct mesh_s {
+  // triangles of a tile, by id, see mesh_triangle
+  tri_t *triangles;
+  // per vertex of the padded grid, the largest stray of it and of every
+  // midpoint its split leads to, so that both triangles along a hypotenuse
+  // split alike and the mesh has no cracks
+  u16 *errors;
+  u32 grid_width;
+  // map the errors were computed for, they are stale when not `valid`
+  u32 width;
+  u32 len;
+  bool valid;
+  // pairs of vertex indices, a point when both are equal, an edge
+  // otherwise, extracted for errors up to `limit` unless `count` is 0
+  u32 *items;
+  u32 count;
+  u32 limit;
+  // per vertex, the point and edge directions from it already extracted
+  u8 *marks;
+};
+
+void free_mesh(mesh_t *mesh) {
+  free(mesh->triangles);
+  free(mesh->errors);
+  free(mesh->items);
+  free(mesh->marks);
+  *mesh = (mesh_t){0};
+}
+
+// triangle `id` of a tile of `side` cells. The bits of id below its leading
+// one pick, lowest first, a half of the tile then a half of every split
+// triangle, so the deeper a triangle the larger its id
+tri_t mesh_triangle(u32 id, i32 side) {
+  tri_t t = {{0, 0}, {side, side}, {side, 0}};
+  if (!(id & 1))
+    t = (tri_t){{side, side}, {0, 0}, {0, side}};
+  while ((id >>= 1) > 1) {
+    vec2 m = {(t.a.x + t.b.x) / 2, (t.a.y + t.b.y) / 2};
+    if (id & 1)
+      t = (tri_t){t.c, t.a, m};
+    else
+      t = (tri_t){t.b, t.c, m};
+  }
+  return t;
+}
+
+bool tri_leaf(tri_t *t) {
+  return ft_abs(t->a.x - t->c.x) + ft_abs(t->a.y - t->c.y) == 1;
+}
+
+bool tri_out(tri_t *t, i32 width, i32 len) {
+  i32 x = t->a.x < t->b.x ? t->a.x : t->b.x;
+  i32 y = t->a.y < t->b.y ? t->a.y : t->b.y;
+  x = t->c.x < x ? t->c.x : x;
+  y = t->c.y < y ? t->c.y : y;
+  return x >= width || y >= len;
+}
+
+bool in_map(vec2 p, i32 width, i32 len) { return p.x < width && p.y < len; }
+
+// error of the midpoint of triangle t, on top of those of its children
+// when it has some. A midpoint whose color differs from either end of its
+// hypotenuse is always split
+void mesh_error(mesh_t *mesh, fdfmap_t *fdf, tri_t *t, bool leaf) {
+  i32 w = mesh->width;
+  i32 l = mesh->len;
+  if (tri_out(t, w, l))
+    return;
+  u32 gw = mesh->grid_width;
+  vec2 m = {(t->a.x + t->b.x) / 2, (t->a.y + t->b.y) / 2};
+  u16 *error = mesh->errors + m.y * gw + m.x;
+  if (!in_map(t->a, w, l) || !in_map(t->b, w, l) || !in_map(t->c, w, l)) {
+    *error = MESH_SPLIT;
+    return;
+  }
+  size_t ia = (size_t)t->a.y * fdf->stride + t->a.x;
+  size_t ib = (size_t)t->b.y * fdf->stride + t->b.x;
+  size_t im = (size_t)m.y * fdf->stride + m.x;
+  // twice the stray, halved rounding up
+  i64 stray = 2 * (i64)fdf->heights[im] - fdf->heights[ia] - fdf->heights[ib];
+  stray = (stray < 0 ? -stray : stray) + 1;
+  u32 e = stray / 2 < MESH_SPLIT ? stray / 2 : MESH_SPLIT - 1;
+  if (fdf->colors && (fdf->colors[im] != fdf->colors[ia] ||
+                      fdf->colors[im] != fdf->colors[ib]))
+    e = MESH_SPLIT;
+  if (!leaf) {
+    u16 left = mesh->errors[(t->a.y + t->c.y) / 2 * gw + (t->a.x + t->c.x) / 2];
+    u16 right =
+        mesh->errors[(t->b.y + t->c.y) / 2 * gw + (t->b.x + t->c.x) / 2];
+    e = left > e ? left : e;
+    e = right > e ? right : e;
+  }
+  if (e > *error)
+    *error = e;
+}
+
+// computes the errors of the first `proj->len` rows of `fdf` bottom up,
+// a level of every tile at a time, so that a midpoint on the border of two
+// tiles gathers the errors of both before its parents read it
+bool mesh_errors(mesh_t *mesh, fdfmap_t *fdf, proj_t *proj) {
+  i32 side = 1 << CULL_LEVEL;
+  u32 gw = proj->blocks_x * side + 1;
+  size_t cells = (size_t)gw * (proj->blocks_y * side + 1);
+  if (mesh->width != proj->width || mesh->len != proj->len ||
+      !mesh->errors) {
+    free_mesh(mesh);
+    size_t n = (size_t)proj->width * proj->len;
+    mesh->triangles = malloc(sizeof(tri_t) * 2 * side * side);
+    mesh->errors = malloc(sizeof(u16) * cells);
+    // at most a point and 4 edges start from every vertex
+    mesh->items = malloc(sizeof(u32) * 2 * 5 * n);
+    mesh->marks = malloc(n);
+    if (!mesh->triangles || !mesh->errors || !mesh->items || !mesh->marks) {
+      free_mesh(mesh);
+      return false;
+    }
+    for (u32 id = 2; id < 2u * side * side; ++id)
+      mesh->triangles[id] = mesh_triangle(id, side);
+    mesh->grid_width = gw;
+    mesh->width = proj->width;
+    mesh->len = proj->len;
+  }
+  memset(mesh->errors, 0, sizeof(u16) * cells);
+  mesh->count = 0;
+  // the ids of a level run from `first` to 2 first - 1
+  for (u32 first = side * side; first >= 2; first /= 2) {
+    for (u32 ty = 0; ty < proj->blocks_y; ++ty) {
+      for (u32 tx = 0; tx < proj->blocks_x; ++tx) {
+        vec2 o = {tx * side, ty * side};
+        for (u32 id = first; id < 2 * first; ++id) {
+          tri_t t = mesh->triangles[id];
+          bool leaf = tri_leaf(&t);
+          t = (tri_t){{t.a.x + o.x, t.a.y + o.y},
+                      {t.b.x + o.x, t.b.y + o.y},
+                      {t.c.x + o.x, t.c.y + o.y}};
+          mesh_error(mesh, fdf, &t, leaf);
+        }
+      }
+    }
+  }
+  mesh->valid = true;
+  return true;
+}
+
+// appends the point p when q is p, the edge p-q otherwise, unless it leaves
+// the map or was already extracted
+void mesh_emit(mesh_t *mesh, vec2 p, vec2 q) {
+  i32 w = mesh->width;
+  if (!in_map(p, w, mesh->len) || !in_map(q, w, mesh->len))
+    return;
+  // edges are kept from their first vertex in row-major order
+  if (q.y < p.y || (q.y == p.y && q.x < p.x)) {
+    vec2 t = p;
+    p = q;
+    q = t;
+  }
+  // the point, then edges going east, south, south east and south west
+  u8 bit = 1;
+  if (q.y == p.y && q.x != p.x)
+    bit = 2;
+  else if (q.y != p.y)
+    bit = q.x == p.x ? 4 : q.x > p.x ? 8 : 16;
+  u32 i = p.y * w + p.x;
+  if (mesh->marks[i] & bit)
+    return;
+  mesh->marks[i] |= bit;
+  mesh->items[2 * mesh->count] = i;
+  mesh->items[2 * mesh->count + 1] = q.y * w + q.x;
+  ++mesh->count;
+}
+
+void mesh_walk(mesh_t *mesh, u32 limit, tri_t *t) {
+  if (tri_out(t, mesh->width, mesh->len))
+    return;
+  vec2 m = {(t->a.x + t->b.x) / 2, (t->a.y + t->b.y) / 2};
+  bool leaf = tri_leaf(t);
+  if (!leaf && mesh->errors[m.y * mesh->grid_width + m.x] > limit) {
+    tri_t left = {t->c, t->a, m};
+    tri_t right = {t->b, t->c, m};
+    mesh_walk(mesh, limit, &left);
+    mesh_walk(mesh, limit, &right);
+    return;
+  }
+  mesh_emit(mesh, t->a, t->a);
+  mesh_emit(mesh, t->b, t->b);
+  mesh_emit(mesh, t->c, t->c);
+  // cells at full resolution are drawn like the grid, without a diagonal
+  if (!leaf)
+    mesh_emit(mesh, t->a, t->b);
+  mesh_emit(mesh, t->b, t->c);
+  mesh_emit(mesh, t->c, t->a);
+}
+
+// largest error left unsplit at `height_scale`
+u32 mesh_limit(i32 height_scale) {
+  u32 scale = height_scale < 0 ? -height_scale : height_scale;
+  return scale ? SIMPLIFY_TOLERANCE / scale : MESH_SPLIT - 1;
+}
+
+// extracts the mesh of the whole map, tile after tile in row-major order.
+// It only depends on the height scale through the limit, which is the same
+// from a few pixels per height unit up
+void extract_mesh(mesh_t *mesh, u32 limit) {
+  memset(mesh->marks, 0, (size_t)mesh->width * mesh->len);
+  mesh->count = 0;
+  mesh->limit = limit;
+  i32 side = 1 << CULL_LEVEL;
+  for (u32 y0 = 0; y0 < mesh->len; y0 += side) {
+    for (u32 x0 = 0; x0 < mesh->width; x0 += side) {
+      for (u32 id = 2; id < 4; ++id) {
+        tri_t t = mesh->triangles[id];
+        t = (tri_t){{t.a.x + x0, t.a.y + y0},
+                    {t.b.x + x0, t.b.y + y0},
+                    {t.c.x + x0, t.c.y + y0}};
+        mesh_walk(mesh, limit, &t);
+      }
+    }
+  }
+}
+
+// draws item k of the mesh, restricted to `clip`. An edge takes the colors
+// of its first vertex, like the edges of the grid
+void draw_mesh_item(mlx_image_t *img, proj_t *proj, u32 k, rect_t *clip) {
+  const u32 *item = proj->mesh->items + 2 * k;
+  u32 point;
+  u32 edges;
+  vertex_colors(proj, item[0], &point, &edges);
+  vec2 pos = {proj->x[item[0]], proj->y[item[0]]};
+  if (item[0] == item[1]) {
+    Color c = hex_to_color(point);
+    draw_circle_clipped(img, &pos, POINT_RADIUS, &c, clip);
+  } else {
+    vec2 end = {proj->x[item[1]], proj->y[item[1]]};
+    draw_line_clipped(img, &pos, &end, edges, clip);
+  }
+}
+
+// what a frame draws are the grid's vertices with their edges, or the
+// mesh's items when simplified
+u32 frame_items(proj_t *proj) {
+  return proj->mesh ? proj->mesh->count : proj->width * proj->len;
+}
+
+// an item of the mesh is culled with the block of its top left corner,
+// whose vertices and edge ends hold it as it lies within a tile
+u8 item_flags(proj_t *proj, u32 k) {
+  const u32 *item = proj->mesh->items + 2 * k;
+  u32 x0 = item[0] % proj->width;
+  u32 x1 = item[1] % proj->width;
+  return block_flags(proj, x0 < x1 ? x0 : x1, item[0] / proj->width);
+}
+
+// first item from i on of a visible block, n if none
+u32 next_item(proj_t *proj, u32 i, u32 n) {
+  if (!proj->mesh)
+    return next_visible(proj, i, n);
+  while (i < n && !(item_flags(proj, i) & CULL_VISIBLE))
+    ++i;
+  return i;
+}
+
+void draw_item(mlx_image_t *img, proj_t *proj, u32 i, rect_t *clip) {
+  if (proj->mesh)
+    draw_mesh_item(img, proj, i, clip);
+  else
+    draw_vertex(img, proj, i, clip);
+}
+
+// tile binned rasterizer: vertices are bucketed by the screen tiles their
+// circle and edges may touch, then the tiles are drawn in parallel. Tiles do
+// not overlap and every bin keeps the vertices in serial order, so the image
+// is byte for byte the one draw_points_serial produces, without any locking
+typedef struct raster_s {
+  pool_t *pool;
+  u32 tiles_x;
+  u32 tiles_y;
+  u32 chunks;
+  // per chunk and tile counters, turned into write cursors by the prefix sum
+  u32 *offsets;
+  // tiles + 1 boundaries of each tile's slice of `bins`
+  u32 *starts;
+  u32 *bins;
+  u32 bins_cap;
+  // current frame
+  mlx_image_t *img;
+  proj_t *proj;
+  // when set, the frame is abandoned as soon as *cancel moves away from
+  // `generation`
+  atomic_uint *cancel;
+  u32 generation;
+} raster_t;
+
+bool raster_cancelled(raster_t *raster) {
+  return raster->cancel &&
+         atomic_load_explicit(raster->cancel, memory_order_relaxed) !=
+             raster->generation;
+}
+
+void free_raster(raster_t *raster) {
+  if (!raster)
+    return;
+  free_pool(raster->pool);
+  free(raster->offsets);
+  free(raster->starts);
+  free(raster->bins);
+  free(raster);
+}
+
+raster_t *new_raster(u32 threads, u32 img_width, u32 img_height) {
+  raster_t *raster = calloc(1, sizeof(raster_t));
+  if (!raster)
+    return NULL;
+  raster->pool = new_pool(threads);
+  raster->tiles_x = (img_width + TILE_SIZE - 1) / TILE_SIZE;
+  raster->tiles_y = (img_height + TILE_SIZE - 1) / TILE_SIZE;
+  raster->chunks = pool_threads(raster->pool) * 4;
+  u32 tiles = raster->tiles_x * raster->tiles_y;
+  raster->offsets = malloc(sizeof(u32) * raster->chunks * tiles);
+  raster->starts = malloc(sizeof(u32) * (tiles + 1));
+  if (!raster->offsets || !raster->starts) {
+    free_raster(raster);
+    return NULL;
+  }
+  return raster;
+}
+
+// inclusive tile range overlapped by item i, false if none
+bool item_tiles(raster_t *raster, u32 i, u32 *tx0, u32 *ty0, u32 *tx1,
+                u32 *ty1) {
+  proj_t *proj = raster->proj;
+  const u32 *item = proj->mesh ? proj->mesh->items + 2 * i : NULL;
+  u32 v = item ? item[0] : i;
+  i32 r = item && item[0] != item[1] ? 0 : POINT_RADIUS - 1;
+  i32 x0 = proj->x[v] - r;
+  i32 x1 = proj->x[v] + r;
+  i32 y0 = proj->y[v] - r;
+  i32 y1 = proj->y[v] + r;
+  if (item) {
+    u32 j = item[1];
+    x0 = proj->x[j] < x0 ? proj->x[j] : x0;
+    x1 = proj->x[j] > x1 ? proj->x[j] : x1;
+    y0 = proj->y[j] < y0 ? proj->y[j] : y0;
+    y1 = proj->y[j] > y1 ? proj->y[j] : y1;
+  } else if ((i + 1) % proj->width) {
+    x0 = proj->x[i + 1] < x0 ? proj->x[i + 1] : x0;
+    x1 = proj->x[i + 1] > x1 ? proj->x[i + 1] : x1;
+    y0 = proj->y[i + 1] < y0 ? proj->y[i + 1] : y0;
+    y1 = proj->y[i + 1] > y1 ? proj->y[i + 1] : y1;
+  }
+  if (!item && i + proj->width < proj->width * proj->len) {
+    u32 j = i + proj->width;
+    x0 = proj->x[j] < x0 ? proj->x[j] : x0;
+    x1 = proj->x[j] > x1 ? proj->x[j] : x1;
+    y0 = proj->y[j] < y0 ? proj->y[j] : y0;
+    y1 = proj->y[j] > y1 ? proj->y[j] : y1;
+  }
+  i32 w = raster->img->width;
+  i32 h = raster->img->height;
+  if (x1 < 0 || y1 < 0 || x0 >= w || y0 >= h)
+    return false;
+  *tx0 = (x0 < 0 ? 0 : x0) / TILE_SIZE;
+  *ty0 = (y0 < 0 ? 0 : y0) / TILE_SIZE;
+  *tx1 = (x1 >= w ? w - 1 : x1) / TILE_SIZE;
+  *ty1 = (y1 >= h ? h - 1 : y1) / TILE_SIZE;
+  return true;
+}
+
+// bins items of chunk c, counting them only when `fill` is false
+void bin_chunk(raster_t *raster, u32 c, bool fill) {
+  proj_t *proj = raster->proj;
+  u32 n = frame_items(proj);
+  u32 per_chunk = (n + raster->chunks - 1) / raster->chunks;
+  u32 from = c * per_chunk;
+  u32 to = from + per_chunk < n ? from + per_chunk : n;
+  u32 *cursor = raster->offsets + c * raster->tiles_x * raster->tiles_y;
+  for (u32 i = next_item(proj, from, to); i < to;
+       i = next_item(proj, i + 1, to)) {
+    u32 tx0, ty0, tx1, ty1;
+    if (!item_tiles(raster, i, &tx0, &ty0, &tx1, &ty1))
+      continue;
+    for (u32 ty = ty0; ty <= ty1; ++ty) {
+      for (u32 tx = tx0; tx <= tx1; ++tx) {
+        u32 t = ty * raster->tiles_x + tx;
+        if (fill)
+          raster->bins[cursor[t]] = i;
+        ++cursor[t];
+      }
+    }
+  }
+}
+
+void bin_count_task(void *ctx, u32 c) { bin_chunk(ctx, c, false); }
+
+void bin_fill_task(void *ctx, u32 c) { bin_chunk(ctx, c, true); }
+
+void draw_tile_task(void *ctx, u32 t) {
+  raster_t *raster = ctx;
+  if (raster_cancelled(raster))
+    return;
+  i32 x0 = (t % raster->tiles_x) * TILE_SIZE;
+  i32 y0 = (t / raster->tiles_x) * TILE_SIZE;
+  rect_t clip = {x0, y0, x0 + TILE_SIZE, y0 + TILE_SIZE};
+  if (clip.x1 > (i32)raster->img->width)
+    clip.x1 = raster->img->width;
+  if (clip.y1 > (i32)raster->img->height)
+    clip.y1 = raster->img->height;
+  for (u32 k = raster->starts[t]; k < raster->starts[t + 1]; ++k)
+    draw_item(raster->img, raster->proj, raster->bins[k], &clip);
+}
+
+// draws every vertex and its east and south edges, or the mesh, checking
+// for cancellation along the way
+bool draw_points_serial(raster_t *raster, mlx_image_t *img, proj_t *proj) {
+  rect_t all = {0, 0, img->width, img->height};
+  u32 n = frame_items(proj);
+  u32 drawn = 0;
+  for (u32 i = next_item(proj, 0, n); i < n; i = next_item(proj, i + 1, n)) {
+    if (!(drawn++ & 1023) && raster && raster_cancelled(raster))
+      return false;
+    draw_item(img, proj, i, &all);
+  }
+  return true;
+}
+
+// draw_points_serial spread over the raster's worker pool, false if the
+// frame got cancelled before completion
+bool draw_points_tiled(raster_t *raster, mlx_image_t *img, proj_t *proj) {
+  if (!raster || !raster->pool || frame_items(proj) < TILED_MIN_VERTICES)
+    return draw_points_serial(raster, img, proj);
+  raster->img = img;
+  raster->proj = proj;
+  u32 tiles = raster->tiles_x * raster->tiles_y;
+  memset(raster->offsets, 0, sizeof(u32) * raster->chunks * tiles);
+  pool_run(raster->pool, bin_count_task, raster, raster->chunks);
+
+  // exclusive prefix sum, tile major then chunk, keeps serial order per bin
+  u32 total = 0;
+  for (u32 t = 0; t < tiles; ++t) {
+    raster->starts[t] = total;
+    for (u32 c = 0; c < raster->chunks; ++c) {
+      u32 count = raster->offsets[c * tiles + t];
+      raster->offsets[c * tiles + t] = total;
+      total += count;
+    }
+  }
+  raster->starts[tiles] = total;
+  if (total > raster->bins_cap) {
+    u32 cap = raster->bins_cap ? raster->bins_cap : 4096;
+    while (cap < total)
+      cap *= 2;
+    u32 *bins = realloc(raster->bins, sizeof(u32) * cap);
+    if (!bins)
+      return draw_points_serial(raster, img, proj);
+    raster->bins = bins;
+    raster->bins_cap = cap;
+  }
+  pool_run(raster->pool, bin_fill_task, raster, raster->chunks);
+  pool_run(raster->pool, draw_tile_task, raster, tiles);
+  return !raster_cancelled(raster);
+}
+
+// floating horizon hidden line removal. The map is walked front to back in
+// diagonal bands of constant x + y, the edges of a band leading to the band
+// in front of it. In every image column, whatever lies between the highest
+// and lowest pixels drawn so far is behind a nearer part of the surface, so
+// edges are only drawn above or below that range. A band only raises the
+// horizons once all its edges are drawn, its edges never hide each other
+typedef struct horizon_s {
+  // empty columns have upper > lower
+  i32 *upper;
+  i32 *lower;
+  // pending updates of the band being drawn, over columns [x0, x1)
+  i32 *band_upper;
+  i32 *band_lower;
+  i32 x0;
+  i32 x1;
+} horizon_t;
+
+// n / d rounded to the nearest integer, d > 0
+i64 round_div(i64 n, i64 d) {
+  n = 2 * n + d;
+  d *= 2;
+  return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+// records that column x is covered from top to bot, both included, for the
+// end of the band
+void horizon_mark(horizon_t *hz, i32 x, i32 top, i32 bot) {
+  hz->band_upper[x] = top < hz->band_upper[x] ? top : hz->band_upper[x];
+  hz->band_lower[x] = bot > hz->band_lower[x] ? bot : hz->band_lower[x];
+  hz->x0 = x < hz->x0 ? x : hz->x0;
+  hz->x1 = x + 1 > hz->x1 ? x + 1 : hz->x1;
+}
+
+// draws the parts of column x from top to bot, both included, that are not
+// hidden, and marks the whole span
+void horizon_span(horizon_t *hz, mlx_image_t *img, i32 x, i32 top, i32 bot,
+                  u32 packed) {
+  rect_t all = {0, 0, img->width, img->height};
+  i32 upper = hz->upper[x];
+  i32 lower = hz->lower[x];
+  if (upper > lower) {
+    fill_vspan(img, x, top, bot + 1, packed, &all);
+  } else {
+    if (top < upper)
+      fill_vspan(img, x, top, (bot < upper ? bot : upper - 1) + 1, packed,
+                 &all);
+    if (bot > lower)
+      fill_vspan(img, x, top > lower ? top : lower + 1, bot + 1, packed, &all);
+  }
+  horizon_mark(hz, x, top, bot);
+}
+
+// walks the line column by column, each column holding one pixel for
+// shallow lines and the run of pixels the line crosses in it for steep ones
+void draw_hidden_edge(horizon_t *hz, mlx_image_t *img, vec2 *src, vec2 *dst,
+                      u32 color) {
+  vec2 a = src->x <= dst->x ? *src : *dst;
+  vec2 b = src->x <= dst->x ? *dst : *src;
+  i64 dx = (i64)b.x - a.x;
+  i64 dy = (i64)b.y - a.y;
+  i32 y_min = a.y < b.y ? a.y : b.y;
+  i32 y_max = a.y < b.y ? b.y : a.y;
+  i32 from = a.x < 0 ? 0 : a.x;
+  i32 to = b.x >= (i32)img->width ? (i32)img->width - 1 : b.x;
+  u32 packed = pack_color(color);
+  for (i32 x = from; x <= to; ++x) {
+    i64 k = x - a.x;
+    i64 top = y_min;
+    i64 bot = y_max;
+    if (dx && (dy < 0 ? -dy : dy) <= dx) {
+      top = a.y + round_div(dy * k, dx);
+      bot = top;
+    } else if (dx) {
+      i64 ya = a.y + round_div(dy * (2 * k - 1), 2 * dx);
+      i64 yb = a.y + round_div(dy * (2 * k + 1), 2 * dx);
+      top = ya < yb ? ya : yb;
+      bot = ya < yb ? yb : ya;
+      top = top < y_min ? y_min : top;
+      bot = bot > y_max ? y_max : bot;
+    }
+    horizon_span(hz, img, x, top, bot, packed);
+  }
+}
+
+// draw_vertex with hidden lines removed. The point is drawn whole when its
+// center is not hidden, its box then hides the farther edges crossing it
+void draw_hidden_vertex(horizon_t *hz, mlx_image_t *img, proj_t *proj, u32 i,
+                        rect_t *clip) {
+  u32 point;
+  u32 edges;
+  vertex_colors(proj, i, &point, &edges);
+  vec2 pos = {proj->x[i], proj->y[i]};
+  if (pos.x >= 0 && pos.x < (i32)img->width &&
+      (hz->upper[pos.x] > hz->lower[pos.x] || pos.y < hz->upper[pos.x] ||
+       pos.y > hz->lower[pos.x])) {
+    Color c = hex_to_color(point);
+    draw_circle_clipped(img, &pos, POINT_RADIUS, &c, clip);
+    i32 r = POINT_RADIUS - 1;
+    for (i32 x = pos.x - r; x <= pos.x + r; ++x) {
+      if (x >= 0 && x < (i32)img->width)
+        horizon_mark(hz, x, pos.y - r, pos.y + r);
+    }
+  }
+  if ((i + 1) % proj->width) {
+    vec2 east = {proj->x[i + 1], proj->y[i + 1]};
+    draw_hidden_edge(hz, img, &pos, &east, edges);
+  }
+  if (i + proj->width < proj->width * proj->len) {
+    vec2 south = {proj->x[i + proj->width], proj->y[i + proj->width]};
+    draw_hidden_edge(hz, img, &pos, &south, edges);
+  }
+}
+
+// serial, the bands depend on each other. False if the frame got cancelled
+// or the horizons could not be allocated
+bool draw_points_hidden(raster_t *raster, mlx_image_t *img, proj_t *proj) {
+  u32 w = img->width;
+  i32 *buf = malloc(sizeof(i32) * 4 * w);
+  if (!buf) {
+    io_printf("error: could not allocate the horizon buffers\n");
+    return false;
+  }
+  horizon_t hz = {buf, buf + w, buf + 2 * w, buf + 3 * w, w, 0};
+  for (u32 x = 0; x < w; ++x) {
+    hz.upper[x] = hz.band_upper[x] = INT_MAX;
+    hz.lower[x] = hz.band_lower[x] = INT_MIN;
+  }
+  rect_t all = {0, 0, w, img->height};
+  u32 width = proj->width;
+  u32 len = proj->len;
+  bool done = true;
+  // the front corner (width - 1, len - 1) is the nearest vertex
+  for (i64 d = (i64)width + len - 2; d >= 0; --d) {
+    if (raster && raster_cancelled(raster)) {
+      done = false;
+      break;
+    }
+    u32 x_from = d >= len ? d - (len - 1) : 0;
+    u32 x_to = d < width ? d : width - 1;
+    for (u32 x = x_from; x <= x_to; ++x) {
+      if (block_flags(proj, x, d - x) & CULL_VISIBLE)
+        draw_hidden_vertex(&hz, img, proj, (d - x) * width + x, &all);
+    }
+    for (i32 x = hz.x0; x < hz.x1; ++x) {
+      if (hz.band_upper[x] < hz.upper[x])
+        hz.upper[x] = hz.band_upper[x];
+      if (hz.band_lower[x] > hz.lower[x])
+        hz.lower[x] = hz.band_lower[x];
+      hz.band_upper[x] = INT_MAX;
+      hz.band_lower[x] = INT_MIN;
+    }
+    hz.x0 = w;
+    hz.x1 = 0;
+  }
+  free(buf);
+  return done;
+}
+
+// transform parameters feeding the projection; a change to any of them marks
+// the projection cache of vars_t dirty, anything else reuses it as is
+#define DIRTY_OFFSET 0x1
+#define DIRTY_ORIGIN 0x2
+#define DIRTY_HEIGHT_SCALE 0x4
+#define DIRTY_MAP 0x8
+// more rows of the same map were loaded
+#define DIRTY_ROWS 0x10
+// the area culling keeps changed, only the visible blocks are reprojected
+#define DIRTY_VIEWPORT 0x20
+#define DIRTY_ALL                                                              \
+  (DIRTY_OFFSET | DIRTY_ORIGIN | DIRTY_HEIGHT_SCALE | DIRTY_MAP | DIRTY_ROWS | \
+   DIRTY_VIEWPORT)
+
+// view state driven by input. In the window the main thread edits
+// vars_t::camera while the render thread draws from its own copy of it
+typedef struct camera_s {
+  int height_scale;
+  // rows of the map shown, less than its `len` while it is still loading
+  u32 rows;
+  // hidden line removal, toggled with H
+  bool hidden;
+  // simplified mesh, toggled with S
+  bool simplify;
+} camera_t;
+
+typedef struct render_s render_t;
+
+typedef struct s_vars {
+  mlx_t *mlx;
+  camera_t camera;
+  render_t *render;
+  mlx_image_t *img;
+  fdfmap_t *fdf;
+  // set while the map is loaded progressively
+  loader_t *loader;
+  u32 rows;
+  bool hidden;
+  // the mesh is drawn instead of the grid, except with hidden lines
+  bool simplify;
+  mesh_t mesh;
+  // decimation of `fdf` actually drawn, when its stride is above 1
+  u32 stride;
+  lod_t lod;
+  int height_scale;
+  u32 offset_x;
+  u32 offset_y;
+  vec2 *origin;
+  u32 background;
+  // projection cache, kept across redraws and only reprojected for the
+  // parameters flagged in `dirty`
+  proj_t *proj;
+  u32 dirty;
+  raster_t *raster;
+  // area touched by the last frame, the only part the next one has to clear
+  rect_t drawn;
+} vars_t;
+
+void set_height_scale(vars_t *vars, int height_scale) {
+  if (height_scale == vars->height_scale)
+    return;
+  vars->height_scale = height_scale;
+  vars->dirty |= DIRTY_HEIGHT_SCALE;
+}
+
+void set_hidden(vars_t *vars, bool hidden) {
+  if (hidden == vars->hidden)
+    return;
+  vars->hidden = hidden;
+  vars->dirty |= DIRTY_VIEWPORT;
+}
+
+void set_rows(vars_t *vars, u32 rows) {
+  if (rows == vars->rows)
+    return;
+  vars->dirty |= rows > vars->rows ? DIRTY_ROWS : DIRTY_MAP;
+  vars->rows = rows;
+}
+
+// offsets for the map as decimated with `stride`, the same as the map's own
+// ones when stride is 1
+void set_stride(vars_t *vars, u32 stride) {
+  vars->stride = stride;
+  u32 width = (vars->fdf->width + stride - 1) / stride;
+  u32 len = (vars->fdf->len + stride - 1) / stride;
+  // offset for scaling in the window
+  i32 h_offset = vars->img->width / width;
+  i32 v_offset = vars->img->height / len;
+  vars->offset_x = h_offset / 4;
+  vars->offset_y = v_offset / 4;
+  vars->dirty |= DIRTY_OFFSET;
+}
+
+// brings the projection cache up to date, reallocating its buffers only when
+// the map size changed, returns NULL if they could not be allocated
+proj_t *update_proj(vars_t *vars) {
+  fdfmap_t *src = vars->fdf;
+  u32 stride =
+      lod_stride(src->width, src->len, vars->img->width, vars->img->height);
+  if (stride != vars->stride)
+    set_stride(vars, stride);
+  if (vars->lod.stride != (stride > 1 ? stride : 0) ||
+      (vars->dirty & DIRTY_MAP)) {
+    free_lod(&vars->lod);
+    if (stride > 1 && !new_lod(&vars->lod, src, stride))
+      return NULL;
+  }
+  // only the first `rows` rows are projected
+  fdfmap_t view = *src;
+  view.len = vars->rows;
+  if (stride > 1) {
+    view = vars->lod.map;
+    view.len = lod_reduce(&vars->lod, src, vars->rows);
+  }
+  fdfmap_t *fdf = &view;
+  if (!vars->proj || vars->proj->width != fdf->width ||
+      vars->proj->len != fdf->len) {
+    free_proj(vars->proj);
+    vars->proj = new_proj(fdf->width, fdf->len);
+    if (!vars->proj)
+      return NULL;
+    vars->dirty |= DIRTY_MAP;
+  }
+  proj_t *proj = vars->proj;
+  if (vars->dirty & ~(DIRTY_HEIGHT_SCALE | DIRTY_VIEWPORT)) {
+    for (u32 b = 0; b < proj->blocks_x * proj->blocks_y; ++b)
+      proj->blocks[b] &= ~CULL_BASED;
+  }
+  if (vars->dirty) {
+    // hidden lines also depend on what lies above and below the window
+    rect_t viewport = {0, 0, vars->img->width, vars->img->height};
+    if (vars->hidden)
+      viewport = (rect_t){0, INT_MIN, vars->img->width, INT_MAX};
+    cull_blocks(proj, src->pyramid, CULL_LEVEL + __builtin_ctz(stride),
+                vars->offset_x, vars->offset_y, vars->origin,
+                vars->height_scale, &viewport);
+    iso_base(fdf, vars->offset_x, vars->offset_y, vars->origin, proj);
+    iso_heights(fdf, vars->height_scale, proj);
+  }
+  // the errors follow the heights of the view, the mesh the height scale
+  if (vars->dirty & (DIRTY_OFFSET | DIRTY_MAP | DIRTY_ROWS))
+    vars->mesh.valid = false;
+  proj->mesh = NULL;
+  if (vars->simplify && !vars->hidden) {
+    mesh_t *mesh = &vars->mesh;
+    if (!mesh->valid && !mesh_errors(mesh, fdf, proj))
+      return NULL;
+    u32 limit = mesh_limit(vars->height_scale);
+    if (!mesh->count || limit != mesh->limit)
+      extract_mesh(mesh, limit);
+    proj->mesh = mesh;
+  }
+  vars->dirty = 0;
+  return proj;
+}
+
+// everything a frame can touch: the vertex bounding box grown by the
+// point radius, edges never leave it since they join two vertices
+rect_t frame_rect(proj_t *proj) {
+  rect_t r = {proj->bounds.x0 - POINT_RADIUS, proj->bounds.y0 - POINT_RADIUS,
+              proj->bounds.x1 + POINT_RADIUS, proj->bounds.y1 + POINT_RADIUS};
+  return r;
+}
+
+// rasterizes the projected map into vars->img, false if cancelled
+bool draw_frame(vars_t *vars, proj_t *proj) {
+  if (vars->hidden)
+    return draw_points_hidden(vars->raster, vars->img, proj);
+  return draw_points_tiled(vars->raster, vars->img, proj);
+}
+
+// false when the frame could not be completed
+bool redraw(vars_t *vars) {
+  proj_t *proj = update_proj(vars);
+  if (!proj) {
+    io_printf("error: could not allocate projection buffers\n");
+    return false;
+  }
+  clear_rect(vars->img, &vars->drawn, vars->background);
+
+  io_printf("redrawing!\n");
+  bool done = draw_frame(vars, proj);
+  vars->drawn = frame_rect(proj);
+  return done;
+}
+
+// field by field, the padding of camera_t holds anything
+bool camera_eq(camera_t *a, camera_t *b) {
+  return a->height_scale == b->height_scale && a->rows == b->rows &&
+         a->hidden == b->hidden && a->simplify == b->simplify;
+}
+
+void apply_camera(vars_t *vars, camera_t *camera) {
+  set_height_scale(vars, camera->height_scale);
+  set_rows(vars, camera->rows);
+  set_hidden(vars, camera->hidden);
+  // the mesh is checked on every update_proj, nothing to reproject
+  vars->simplify = camera->simplify;
+}
+
+// renders on its own thread into a canvas outside of the window, whose
+// pixels frame_hook swaps with the window image's once complete: mlx_loop
+// uploads that image every frame, so only the main thread may touch it.
+// Every camera change bumps `generation`, which makes an in-flight frame
+// give up, so the shown image is at most one render behind the input
+struct render_s {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  atomic_uint generation;
+  // generation last rendered, and whether that frame awaits its swap
+  u32 rendered;
+  bool ready;
+  bool stop;
+  camera_t camera;
+  mlx_image_t *window;
+  mlx_image_t *canvas;
+  // area drawn in the window image and in the canvas, what the next frame
+  // in them has to clear
+  rect_t shown;
+  rect_t drawn;
+  vars_t *vars;
+};
+
+void *render_loop(void *param) {
+  render_t *render = param;
+  vars_t *vars = render->vars;
+  pthread_mutex_lock(&render->lock);
+  for (;;) {
+    while (!render->stop &&
+           (render->ready ||
+            render->rendered == atomic_load(&render->generation)))
+      pthread_cond_wait(&render->wake, &render->lock);
+    if (render->stop)
+      break;
+    u32 generation = atomic_load(&render->generation);
+    camera_t camera = render->camera;
+    pthread_mutex_unlock(&render->lock);
+
+    apply_camera(vars, &camera);
+    vars->img = render->canvas;
+    vars->drawn = render->drawn;
+    if (vars->raster) {
+      vars->raster->cancel = &render->generation;
+      vars->raster->generation = generation;
+    }
+    bool done = redraw(vars);
+    // a cancelled frame leaves unknown pixels behind, clear it all next time
+    rect_t all = {0, 0, vars->img->width, vars->img->height};
+    render->drawn = done ? vars->drawn : all;
+
+    pthread_mutex_lock(&render->lock);
+    render->rendered = generation;
+    render->ready = done;
+  }
+  pthread_mutex_unlock(&render->lock);
+  return NULL;
+}
+
+// image of `width` x `height` pixels outside of the window. Both mlx and
+// the canvas allocate pixels with malloc, so they can swap them freely
+mlx_image_t *new_canvas(u32 width, u32 height) {
+  mlx_image_t *canvas = malloc(sizeof(mlx_image_t));
+  u8 *pixels = malloc((size_t)width * height * 4);
+  if (!canvas || !pixels) {
+    free(canvas);
+    free(pixels);
+    return NULL;
+  }
+  mlx_image_t img = {.width = width, .height = height, .pixels = pixels};
+  memcpy(canvas, &img, sizeof(mlx_image_t));
+  return canvas;
+}
+
+void free_canvas(mlx_image_t *canvas) {
+  if (!canvas)
+    return;
+  free(canvas->pixels);
+  free(canvas);
+}
+
+void stop_render(render_t *render) {
+  if (!render)
+    return;
+  pthread_mutex_lock(&render->lock);
+  render->stop = true;
+  pthread_cond_signal(&render->wake);
+  pthread_mutex_unlock(&render->lock);
+  pthread_join(render->thread, NULL);
+  pthread_mutex_destroy(&render->lock);
+  pthread_cond_destroy(&render->wake);
+  free_canvas(render->canvas);
+  free(render);
+}
+
+// `window` is already on screen holding the current frame
+render_t *start_render(vars_t *vars, mlx_image_t *window) {
+  render_t *render = calloc(1, sizeof(render_t));
+  if (!render)
+    return NULL;
+  render->canvas = new_canvas(window->width, window->height);
+  if (!render->canvas) {
+    free(render);
+    return NULL;
+  }
+  render->vars = vars;
+  render->window = window;
+  render->shown = vars->drawn;
+  render->drawn = (rect_t){0, 0, window->width, window->height};
+  render->camera = vars->camera;
+  pthread_mutex_init(&render->lock, NULL);
+  pthread_cond_init(&render->wake, NULL);
+  if (pthread_create(&render->thread, NULL, render_loop, render)) {
+    pthread_mutex_destroy(&render->lock);
+    pthread_cond_destroy(&render->wake);
+    free_canvas(render->canvas);
+    free(render);
+    return NULL;
+  }
+  return render;
+}
+
+// input only updates the camera state, rendering happens on the render
+// thread, started at most once per displayed frame by frame_hook however
+// many events came in meanwhile
+void key_handler(mlx_key_data_t keydata, void *param) {
+  vars_t *vars = (vars_t *)param;
+  camera_t *camera = &vars->camera;
+  // held keys repeat, so holding UP/DOWN keeps changing the scale
+  bool down = keydata.action == MLX_PRESS || keydata.action == MLX_REPEAT;
+  if (keydata.key == MLX_KEY_UP && down) {
+    io_printf("key_up event!\n");
+    if (camera->height_scale + 1 < 30)
+      camera->height_scale += 1;
+  } else if (keydata.key == MLX_KEY_DOWN && down) {
+    io_printf("key_down event!\n");
+    if (camera->height_scale - 1 > -10)
+      camera->height_scale -= 1;
+  } else if (keydata.key == MLX_KEY_H && keydata.action == MLX_PRESS) {
+    io_printf("key_h event!\n");
+    camera->hidden = !camera->hidden;
+  } else if (keydata.key == MLX_KEY_S && keydata.action == MLX_PRESS) {
+    io_printf("key_s event!\n");
+    camera->simplify = !camera->simplify;
+  } else if (keydata.key == MLX_KEY_ESCAPE && keydata.action == MLX_PRESS) {
+    mlx_close_window(vars->mlx);
+  }
+}
+
+// shows a finished canvas and hands the latest camera to the render
+// thread, cancelling the frame it may be working on
+void frame_hook(void *param) {
+  vars_t *vars = (vars_t *)param;
+  render_t *render = vars->render;
+  pthread_mutex_lock(&render->lock);
+  if (render->ready) {
+    u8 *pixels = render->window->pixels;
+    render->window->pixels = render->canvas->pixels;
+    render->canvas->pixels = pixels;
+    rect_t shown = render->shown;
+    render->shown = render->drawn;
+    render->drawn = shown;
+    render->ready = false;
+    pthread_cond_signal(&render->wake);
+  }
+  // newly loaded rows wait for the render thread to be idle rather than
+  // cancelling the frame it is drawing, or a fast loader would starve it
+  if (vars->loader && !render->ready &&
+      render->rendered == atomic_load(&render->generation)) {
+    vars->camera.rows = atomic_load_explicit(&vars->loader->rows_ready,
+                                             memory_order_acquire);
+    attach_pyramid(vars->loader, vars->fdf);
+  }
+  if (!camera_eq(&render->camera, &vars->camera)) {
+    render->camera = vars->camera;
+    atomic_fetch_add(&render->generation, 1);
+    pthread_cond_signal(&render->wake);
+  }
+  pthread_mutex_unlock(&render->lock);
+}
+
+// zlib stream of `raw` made of stored deflate blocks
+u8 *zlib_store(const u8 *raw, size_t len, size_t *out_len) {
+  size_t blocks = len / 0xffff + 1;
+  u8 *z = malloc(2 + blocks * 5 + len + 4);
+  if (!z)
+    return NULL;
+  size_t n = 0;
+  z[n++] = 0x78;
+  z[n++] = 0x01;
+  size_t done = 0;
+  do {
+    u32 part = len - done > 0xffff ? 0xffff : len - done;
+    z[n++] = done + part == len;
+    z[n++] = part & 0xff;
+    z[n++] = part >> 8;
+    z[n++] = ~part & 0xff;
+    z[n++] = (~part >> 8) & 0xff;
+    memcpy(z + n, raw + done, part);
+    n += part;
+    done += part;
+  } while (done < len);
+  u32 a = 1;
+  u32 b = 0;
+  for (size_t i = 0; i < len; ++i) {
+    a = (a + raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  u32 adler = (b << 16) | a;
+  for (i32 k = 3; k >= 0; --k)
+    z[n++] = adler >> (k * 8);
+  *out_len = n;
+  return z;
+}
+
+// writes RGBA pixels as a PNG. The lodepng built into libmlx42 only has
+// its decoder, so the image data goes in stored deflate blocks framed
+// here, while lodepng still builds the chunks (with their CRC) and writes
+// the file. Returns 0 on success
+int write_png(const char *path, const u8 *pixels, u32 width, u32 height) {
+  size_t row = (size_t)width * 4;
+  size_t raw_len = (row + 1) * height;
+  u8 *raw = malloc(raw_len);
+  u8 *png = malloc(8);
+  if (!raw || !png) {
+    free(raw);
+    free(png);
+    return 1;
+  }
+  // every scanline starts with filter type 0 (none)
+  for (u32 y = 0; y < height; ++y) {
+    raw[y * (row + 1)] = 0;
+    memcpy(raw + y * (row + 1) + 1, pixels + y * row, row);
+  }
+  size_t z_len;
+  u8 *z = zlib_store(raw, raw_len, &z_len);
+  free(raw);
+  if (!z) {
+    free(png);
+    return 1;
+  }
+  const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  memcpy(png, signature, 8);
+  size_t png_len = 8;
+  // 8 bit RGBA, default compression and filtering, not interlaced
+  u8 ihdr[13] = {width >> 24,  width >> 16,  width >> 8,  width,
+                 height >> 24, height >> 16, height >> 8, height,
+                 8,            6,            0,           0,
+                 0};
+  unsigned err = lodepng_chunk_create(&png, &png_len, 13, "IHDR", ihdr);
+  if (!err)
+    err = lodepng_chunk_create(&png, &png_len, z_len, "IDAT", z);
+  if (!err)
+    err = lodepng_chunk_create(&png, &png_len, 0, "IEND", NULL);
+  if (!err)
+    err = lodepng_save_file(png, png_len, path);
+  free(z);
+  free(png);
+  return err != 0;
+}
+
+// command line: `fdf [--headless --out frame.png] [--hidden] [--simplify]
+//                   <map.fdf>`
+//           or: `fdf --bench <map.fdf> [--frames N] [--hidden] [--simplify]`
+typedef struct opts_s {
+  char *map_path;
+  bool headless;
+  char *out_path;
+  bool bench;
+  u32 frames;
+  bool convert;
+  bool bench_parse;
+  char *cache_dir;
+  bool no_cache;
+  bool hidden;
+  bool simplify;
+} opts_t;
+
+bool parse_args(int argc, char **argv, opts_t *opts) {
+  *opts = (opts_t){.frames = 100};
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--headless")) {
+      opts->headless = true;
+    } else if (!strcmp(argv[i], "--bench") && i + 1 < argc) {
+      opts->bench = true;
+      opts->map_path = argv[++i];
+    } else if (!strcmp(argv[i], "--bench-parse") && i + 1 < argc) {
+      opts->bench_parse = true;
+      opts->map_path = argv[++i];
+    } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+      i32 frames = ft_atoi(argv[++i]);
+      if (frames <= 0) {
+        io_printf("error: --frames needs a positive count\n");
+        return false;
+      }
+      opts->frames = frames < MAX_BENCH_FRAMES ? frames : MAX_BENCH_FRAMES;
+    } else if (!strcmp(argv[i], "--convert") && i + 2 < argc) {
+      opts->convert = true;
+      opts->map_path = argv[++i];
+      opts->out_path = argv[++i];
+    } else if (!strcmp(argv[i], "--cache-dir") && i + 1 < argc) {
+      opts->cache_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--no-cache")) {
+      opts->no_cache = true;
+    } else if (!strcmp(argv[i], "--hidden")) {
+      opts->hidden = true;
+    } else if (!strcmp(argv[i], "--simplify")) {
+      opts->simplify = true;
+    } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+      opts->out_path = argv[++i];
+    } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+      io_printf("error: unknown option `%s`\n", argv[i]);
+      return false;
+    } else {
+      opts->map_path = argv[i];
+    }
+  }
+  if (!opts->map_path) {
+    io_printf("error: missing fdf file as argument\n");
+    return false;
+  }
+  if (opts->headless && !opts->out_path) {
+    io_printf("error: --headless needs an --out file\n");
+    return false;
+  }
+  return true;
+}
+
+fdfmap_t *load_fdf_path(char *fdf_path, const char *cache_dir,
+                        loader_t *loader) {
+  int fdf_file = open(fdf_path, O_RDONLY);
+  if (fdf_file < 0) {
+    io_printf(
+        "error: fdf file path provided does not exist, check path: `%s`\n",
+        fdf_path);
+    return NULL;
+  }
+
+  // load fdf into a buffer
+  io_printf("loading fdf from `%s` into memory...", fdf_path);
+  fdfmap_t *fdf = load_fdf(fdf_file, fdf_path, cache_dir, loader);
+  if (fdf)
+    io_printf("success\n");
+  // a loader builds it itself, after publishing the map
+  if (fdf && !loader)
+    fdf->pyramid = new_pyramid(fdf, 0);
+  io_printf("closing fd\n");
+  close(fdf_file);
+  return fdf;
+}
+
+void *loader_main(void *param) {
+  loader_t *loader = param;
+  fdfmap_t *fdf = load_fdf_path(loader->path, loader->cache_dir, loader);
+  pthread_mutex_lock(&loader->lock);
+  // binary and cached maps are only published here, whole
+  loader->fdf = fdf;
+  loader->failed = !fdf;
+  loader->done = true;
+  if (fdf && !atomic_load(&loader->stop))
+    publish_rows(loader, fdf->len);
+  pthread_cond_broadcast(&loader->progress);
+  pthread_mutex_unlock(&loader->lock);
+  if (!fdf || atomic_load(&loader->stop))
+    return NULL;
+  pyramid_t *pyramid = new_pyramid(fdf, 0);
+  pthread_mutex_lock(&loader->lock);
+  loader->pyramid = pyramid;
+  pthread_mutex_unlock(&loader->lock);
+  return NULL;
+}
+
+// starts loading `fdf_path` in the background, taking ownership of
+// `cache_dir`
+loader_t *start_loader(char *fdf_path, char *cache_dir) {
+  loader_t *loader = calloc(1, sizeof(loader_t));
+  if (!loader) {
+    free(cache_dir);
+    return NULL;
+  }
+  loader->path = fdf_path;
+  loader->cache_dir = cache_dir;
+  pthread_mutex_init(&loader->lock, NULL);
+  pthread_cond_init(&loader->progress, NULL);
+  if (pthread_create(&loader->thread, NULL, loader_main, loader)) {
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->progress);
+    free(cache_dir);
+    free(loader);
+    return NULL;
+  }
+  return loader;
+}
+
+// waits until the map is allocated and has at least one row to draw, NULL if
+// it failed to load
+fdfmap_t *wait_loader(loader_t *loader) {
+  pthread_mutex_lock(&loader->lock);
+  while (!loader->failed &&
+         !(loader->fdf && atomic_load(&loader->rows_ready) > 0))
+    pthread_cond_wait(&loader->progress, &loader->lock);
+  fdfmap_t *fdf = loader->failed ? NULL : loader->fdf;
+  pthread_mutex_unlock(&loader->lock);
+  return fdf;
+}
+
+// cancels the load if still running and returns the map, for the caller to
+// free, NULL if it failed
+fdfmap_t *stop_loader(loader_t *loader) {
+  atomic_store(&loader->stop, true);
+  pthread_join(loader->thread, NULL);
+  fdfmap_t *fdf = loader->fdf;
+  if (fdf)
+    attach_pyramid(loader, fdf);
+  pthread_mutex_destroy(&loader->lock);
+  pthread_cond_destroy(&loader->progress);
+  free(loader->cache_dir);
+  free(loader);
+  return fdf;
+}
+
+// view parameters fitting the map to the image, shared by every mode
+void init_vars(vars_t *vars, fdfmap_t *fdf, mlx_image_t *img, vec2 *origin) {
+  *origin = (vec2){img->width / 2, img->height / 3};
+  *vars = (vars_t){.camera = {.height_scale = 1, .rows = fdf->len},
+                   .img = img,
+                   .fdf = fdf,
+                   .rows = fdf->len,
+                   .height_scale = 1,
+                   .origin = origin,
+                   .background = 0x3333333f,
+                   .proj = NULL,
+                   .dirty = DIRTY_ALL,
+                   .raster = new_raster(0, img->width, img->height),
+                   // nothing was ever cleared, so the first redraw clears all
+                   .drawn = {0, 0, img->width, img->height}};
+  set_stride(vars, lod_stride(fdf->width, fdf->len, img->width, img->height));
+}
+
+void free_vars(vars_t *vars) {
+  free_lod(&vars->lod);
+  free_mesh(&vars->mesh);
+  free_raster(vars->raster);
+  free_proj(vars->proj);
+}
+
+// renders one frame into a plain RGBA buffer, no window or GL context
+// involved, and writes it as a PNG
+int run_headless(fdfmap_t *fdf, char *out_path, bool hidden, bool simplify) {
+  u8 *pixels = malloc((size_t)WIN_WIDTH * WIN_HEIGHT * 4);
+  if (!pixels) {
+    io_printf("fatal: could not allocate the frame buffer\n");
+    return 1;
+  }
+  mlx_image_t img = {.width = WIN_WIDTH, .height = WIN_HEIGHT, .pixels = pixels};
+  vec2 iso_center;
+  vars_t vars;
+  init_vars(&vars, fdf, &img, &iso_center);
+  vars.hidden = hidden;
+  vars.simplify = simplify;
+  redraw(&vars);
+  int ret = 0;
+  if (!vars.proj) {
+    ret = 1;
+  } else if (write_png(out_path, pixels, img.width, img.height)) {
+    io_printf("error: could not write `%s`\n", out_path);
+    ret = 1;
+  } else {
+    io_printf("wrote `%s`\n", out_path);
+  }
+  free_vars(&vars);
+  free(pixels);
+  return ret;
+}
+
+u64 now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int cmp_u64(const void *a, const void *b) {
+  u64 x = *(const u64 *)a;
+  u64 y = *(const u64 *)b;
+  return (x > y) - (x < y);
+}
+
+// prints ns as microseconds with two decimals
+void print_us(u64 ns) {
+  u64 cus = ns / 10;
+  io_printf("%d.%d%dus", (int)(cus / 100), (int)(cus / 10 % 10),
+            (int)(cus % 10));
+}
+
+// sorts the samples in place and prints their min, median and p99
+void print_stage(char *name, u64 *samples, u32 n) {
+  qsort(samples, n, sizeof(u64), cmp_u64);
+  u32 p99 = (n * 99 + 99) / 100;
+  io_printf("  %s  min ", name);
+  print_us(samples[0]);
+  io_printf("  median ");
+  print_us(samples[n / 2]);
+  io_printf("  p99 ");
+  print_us(samples[(p99 ? p99 : 1) - 1]);
+  io_printf("\n");
+}
+
+enum bench_stage {
+  BENCH_PARSE,
+  BENCH_PYRAMID,
+  BENCH_PROJECT,
+  BENCH_CLEAR,
+  BENCH_RASTER,
+  BENCH_PRESENT,
+  BENCH_STAGES
+};
+
+// renders `frames` headless frames, reloading the map and reprojecting it
+// from scratch each time, and reports the timings of every stage. Present
+// is the copy of the finished frame into a front buffer, what handing it
+// to the window costs at the very least
+int run_bench(char *fdf_path, u32 frames, bool hidden, bool simplify) {
+  char *names[BENCH_STAGES] = {"parse  ", "pyramid", "project",
+                               "clear  ", "raster ", "present"};
+  u64 *samples = malloc(sizeof(u64) * frames * BENCH_STAGES);
+  size_t frame_size = (size_t)WIN_WIDTH * WIN_HEIGHT * 4;
+  u8 *back = malloc(frame_size);
+  u8 *front = malloc(frame_size);
+  if (!samples || !back || !front) {
+    io_printf("fatal: could not allocate the bench buffers\n");
+    free(samples);
+    free(back);
+    free(front);
+    return 1;
+  }
+  mlx_image_t img = {.width = WIN_WIDTH, .height = WIN_HEIGHT, .pixels = back};
+  vec2 iso_center;
+  vars_t vars = {0};
+  u32 width = 0;
+  u32 len = 0;
+  int ret = 0;
+  for (u32 f = 0; f < frames && !ret; ++f) {
+    u64 *t = samples + f * BENCH_STAGES;
+    int fd = open(fdf_path, O_RDONLY);
+    if (fd < 0) {
+      io_printf("error: could not open `%s`\n", fdf_path);
+      ret = 1;
+      break;
+    }
+    u64 start = now_ns();
+    // uncached, this measures the parser
+    fdfmap_t *fdf = load_fdf(fd, fdf_path, NULL, NULL);
+    t[BENCH_PARSE] = now_ns() - start;
+    close(fd);
+    if (!fdf) {
+      ret = 1;
+      break;
+    }
+    start = now_ns();
+    fdf->pyramid = new_pyramid(fdf, 0);
+    t[BENCH_PYRAMID] = now_ns() - start;
+    if (!f) {
+      init_vars(&vars, fdf, &img, &iso_center);
+      vars.hidden = hidden;
+      vars.simplify = simplify;
+      if (!vars.raster) {
+        io_printf("fatal: could not allocate the bench buffers\n");
+        free_fdf(fdf);
+        ret = 1;
+        break;
+      }
+    }
+    vars.fdf = fdf;
+    vars.dirty = DIRTY_ALL;
+    width = fdf->width;
+    len = fdf->len;
+
+    start = now_ns();
+    if (!update_proj(&vars))
+      ret = 1;
+    t[BENCH_PROJECT] = now_ns() - start;
+    if (!ret) {
+      start = now_ns();
+      clear_rect(&img, &vars.drawn, vars.background);
+      t[BENCH_CLEAR] = now_ns() - start;
+      start = now_ns();
+      draw_frame(&vars, vars.proj);
+      vars.drawn = frame_rect(vars.proj);
+      t[BENCH_RASTER] = now_ns() - start;
+      start = now_ns();
+      memcpy(front, back, frame_size);
+      t[BENCH_PRESENT] = now_ns() - start;
+    }
+    free_fdf(fdf);
+  }
+  if (!ret) {
+    io_printf("bench `%s` (%dx%d), %d frames on %d threads\n", fdf_path,
+              width, len, frames, pool_threads(vars.raster->pool));
+    // regroup the samples per stage
+    u64 *stage = malloc(sizeof(u64) * frames);
+    for (u32 s = 0; stage && s < BENCH_STAGES; ++s) {
+      for (u32 f = 0; f < frames; ++f)
+        stage[f] = samples[f * BENCH_STAGES + s];
+      print_stage(names[s], stage, frames);
+    }
+    free(stage);
+  }
+  free_vars(&vars);
+  free(samples);
+  free(back);
+  free(front);
+  return ret;
+}
+
+// times `runs` parses of an already mapped text map, on one thread then on
+// every core, and reports them with the median throughput
+int run_bench_parse(char *fdf_path, u32 runs) {
+  int fd = open(fdf_path, O_RDONLY);
+  if (fd < 0) {
+    io_printf("error: could not open `%s`\n", fdf_path);
+    return 1;
+  }
+  struct stat st;
+  char *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  u64 *samples = malloc(sizeof(u64) * runs);
+  if (data == MAP_FAILED || !samples || is_fdfb(data, st.st_size)) {
+    io_printf("error: `%s` is not a text map that could be mapped\n",
+              fdf_path);
+    if (data != MAP_FAILED)
+      munmap(data, st.st_size);
+    free(samples);
+    return 1;
+  }
+  u32 cores = sysconf(_SC_NPROCESSORS_ONLN);
+  io_printf("bench-parse `%s` (%d KiB), %d runs\n", fdf_path,
+            (int)(st.st_size >> 10), runs);
+  char *names[2] = {"serial ", "pooled "};
+  u32 threads[2] = {1, 0};
+  u32 mbps[2] = {0};
+  int ret = 0;
+  for (u32 k = 0; k < 2 && !ret; ++k) {
+    for (u32 r = 0; r < runs && !ret; ++r) {
+      u64 start = now_ns();
+      fdfmap_t *fdf = parse_fdf(data, st.st_size, fdf_path, threads[k], NULL);
+      samples[r] = now_ns() - start;
+      ret = !fdf;
+      free_fdf(fdf);
+    }
+    if (!ret) {
+      print_stage(names[k], samples, runs);
+      mbps[k] = (u64)st.st_size * 1000 / (samples[runs / 2] ? samples[runs / 2]
+                                                            : 1);
+    }
+  }
+  if (!ret)
+    io_printf("  throughput  serial %d MB/s  pooled %d MB/s (%d threads)\n",
+              mbps[0], mbps[1], cores);
+  munmap(data, st.st_size);
+  free(samples);
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  io_printf("Startup of fdf...\n");
+  // load  of file from args
+  opts_t opts;
+  if (!parse_args(argc, argv, &opts)) {
+    io_printf("usage: fdf [--headless --out frame.png] [--hidden] "
+              "[--simplify] [--cache-dir dir | --no-cache] <map.fdf>\n"
+              "       fdf --bench <map.fdf> [--frames N] [--hidden] "
+              "[--simplify]\n"
+              "       fdf --bench-parse <map.fdf> [--frames N]\n"
+              "       fdf --convert <in.fdf> <out.fdfb>\n");
+    return 1;
+  }
+
+  if (opts.convert)
+    return run_convert(opts.map_path, opts.out_path);
+
+  if (opts.bench)
+    return run_bench(opts.map_path, opts.frames, opts.hidden, opts.simplify);
+  if (opts.bench_parse)
+    return run_bench_parse(opts.map_path, opts.frames);
+
+  char *fdf_path = opts.map_path;
+  char *cache_dir = opts.no_cache ? NULL : cache_dir_path(opts.cache_dir);
+  if (opts.headless) {
+    fdfmap_t *fdf = load_fdf_path(fdf_path, cache_dir, NULL);
+    free(cache_dir);
+    if (!fdf) {
+      io_printf("fatal: failed to load `%s` into memory, exiting\n",
+                fdf_path);
+      return 1;
+    }
+    int ret = run_headless(fdf, opts.out_path, opts.hidden, opts.simplify);
+    free_fdf(fdf);
+    return ret;
+  }
+
+  // the window comes up while the map loads, drawing its rows as they come
+  loader_t *loader = start_loader(fdf_path, cache_dir);
+  if (!loader) {
+    io_printf("fatal: could not start the loader thread, exiting\n");
+    return 1;
+  }
+
+  //////////////////////
+  /// graphical part ///
+  //////////////////////
+
+  // start window
+  io_printf("initializing mlx_window...");
+  mlx_t *mlx = mlx_init(WIN_WIDTH, WIN_HEIGHT, "fdf", 0);
+  if (!mlx) {
+    free_fdf(stop_loader(loader));
+    return 1;
+  }
+  io_printf("success\n");
+
+  // the render thread draws aside, see render_s
+  mlx_image_t *img = mlx_new_image(mlx, WIN_WIDTH, WIN_HEIGHT);
+  if (!img || (mlx_image_to_window(mlx, img, 0, 0)) < 0)
+    return 1;
+
+  fdfmap_t *fdf = wait_loader(loader);
+  if (!fdf) {
+    io_printf("fatal: failed to load `%s` into memory, exiting\n", fdf_path);
+    stop_loader(loader);
+    mlx_terminate(mlx);
+    return 1;
+  }
+
+  vec2 iso_center;
+  vars_t vars;
+  init_vars(&vars, fdf, img, &iso_center);
+  vars.mlx = mlx;
+  vars.loader = loader;
+  vars.rows = atomic_load(&loader->rows_ready);
+  vars.camera.rows = vars.rows;
+  vars.hidden = vars.camera.hidden = opts.hidden;
+  vars.simplify = vars.camera.simplify = opts.simplify;
+  if (!update_proj(&vars)) {
+    io_printf("fatal: could not allocate projection buffers, exiting\n");
+    free_vars(&vars);
+    free_fdf(stop_loader(loader));
+    mlx_terminate(mlx);
+    return 1;
+  }
+  draw_frame(&vars, vars.proj);
+
+  vars.render = start_render(&vars, img);
+  if (!vars.render) {
+    io_printf("fatal: could not start the render thread, exiting\n");
+    free_vars(&vars);
+    free_fdf(stop_loader(loader));
+    mlx_terminate(mlx);
+    return 1;
+  }
+
+  io_printf("starting mlx loop\n");
   mlx_key_hook(mlx, key_handler, (void *)&vars);
+  mlx_loop_hook(mlx, frame_hook, (void *)&vars);
 
   mlx_loop(mlx);
 
-  free_buf(fdf->buf, fdf->len);
+  stop_render(vars.render);
+  free_vars(&vars);
+  free_fdf(stop_loader(loader));
   io_printf("closing...\n");
   mlx_terminate(mlx);
   return 0;